@@ -4,416 +4,3095 @@
 /// @copyright Public domain.
 /// @license CC0 1.0
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <mutex>
 #include <thread>
 #include "jobs.h"
 
+#if defined(__linux__)
+	#include <pthread.h>
+	#include <fcntl.h>
+	#include <sched.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <sys/un.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+	#include <malloc.h>
+#endif
+
 //
 // global
 //
 
 #define NS_PER_SEC 1000000000ULL
+#define CACHE_LINE 64ULL
+
+#if defined(__GNUC__) || defined(__clang__)
+	#define PREFETCH(p) __builtin_prefetch(p)
+#else
+	#define PREFETCH(p)
+#endif
 
 uint64_t cc0::jobs_internal::new_uuid( void )
 {
-	static uint64_t uuid = 1; // Never allocate UUID=0 as we reserve that.
-	return uuid++;
+	static std::atomic<uint64_t> uuid(1); // Never allocate UUID=0 as we reserve that.
+	return uuid.fetch_add(1);
+}
+
+static uint64_t now_ns( void )
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
 }
 
 //
-// rtti
+// allocation
 //
 
-void *cc0::jobs_internal::rtti::self(uint64_t type_id)
+#define POOL_GRANULARITY 16ULL
+#define POOL_CLASSES     64ULL // Slots of up to 1 KB, so that jobs with a fair amount of data of their own are still pooled.
+#define POOL_CHUNK_SIZE  (16ULL * 1024ULL)
+#define POOL_NODES       8ULL
+#define HUGE_PAGE_SIZE   (2ULL * 1024ULL * 1024ULL)
+
+static_assert(POOL_GRANULARITY % CC0_JOBS_MAX_PAYLOAD_ALIGN == 0, "Pooled memory must be aligned for any data sent with events.");
+
+struct pool_slot
 {
-	return this->type_id() == type_id ? this : nullptr;
-}
+	pool_slot *next;
+};
 
-const void *cc0::jobs_internal::rtti::self(uint64_t type_id) const
+struct pool_chunk
 {
-	return this->type_id() == type_id ? this : nullptr;
-}
+	pool_chunk *next; // The next chunk of the pool.
+	int64_t     node; // The node whose pools the chunk was allocated for. -1 for no preference.
+};
 
-cc0::jobs_internal::rtti::~rtti( void )
-{}
+static_assert(sizeof(pool_chunk) <= POOL_GRANULARITY, "The chunk header must fit in front of the first slot.");
+static_assert(HUGE_PAGE_SIZE % POOL_CHUNK_SIZE == 0, "Huge pages must split evenly into chunks.");
 
-uint64_t cc0::jobs_internal::rtti::type_id( void )
+struct pool_class
 {
-	static const uint64_t id = cc0::jobs_internal::new_uuid();
-	return id;
+	pool_slot  *free;       // Slots that are ready to be allocated.
+	pool_chunk *chunks;     // Chunks of memory that slots are carved from. Each chunk is aligned to its size so that a slot finds its chunk header by masking its address.
+	uint64_t    free_count; // The number of slots in the free list.
+};
+
+static thread_local pool_class            g_pools[POOL_NODES + 1][POOL_CLASSES]; // The first set of pools has no node preference. Each thread has its own pools so that threads never contend.
+static bool                                g_huge_pages      = false;
+static cc0::jobs_internal::allocation_trap g_allocation_trap = nullptr;
+static thread_local bool                   g_inside_trap     = false;
+static thread_local int64_t                g_memory_node     = -1;
+
+static uint64_t pool_index(uint64_t size)
+{
+	return size > 0 ? (size - 1) / POOL_GRANULARITY : 0;
 }
 
-cc0::jobs_internal::rtti *cc0::jobs_internal::rtti::instance( void )
+static pool_class &get_pool(uint64_t index)
 {
-	return new rtti;
+	return g_pools[g_memory_node + 1][index];
 }
 
-uint64_t cc0::jobs_internal::rtti::object_id( void ) const
+static void *heap_allocate(uint64_t size, const void *call_site)
 {
-	return type_id();
+	cc0::jobs_internal::check_allocation(size, call_site);
+	void *p = std::malloc(size > 0 ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
 }
 
-const char *cc0::jobs_internal::rtti::object_name( void ) const
+static void *aligned_heap_allocate(uint64_t size, uint64_t align)
 {
-	return type_name();
+	void *p = nullptr;
+#if defined(_WIN32)
+	p = _aligned_malloc(size, align);
+#else
+	if (posix_memalign(&p, align, size) != 0) {
+		p = nullptr;
+	}
+#endif
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
 }
 
-const char *cc0::jobs_internal::rtti::type_name( void )
+#if defined(__linux__)
+// Maps more memory than requested and unmaps the excess on both sides so that the remainder is aligned.
+static void *map_aligned(uint64_t size, uint64_t align)
 {
-	return "rtti";
+	uint8_t *p = reinterpret_cast<uint8_t*>(mmap(nullptr, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (p == MAP_FAILED) {
+		return MAP_FAILED;
+	}
+	uint8_t *aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~uintptr_t(align - 1));
+	if (aligned > p) {
+		munmap(p, uint64_t(aligned - p));
+	}
+	munmap(aligned + size, align - uint64_t(aligned - p));
+	return aligned;
 }
+#endif
 
-//
-// fn_callback
-//
-
-cc0::job::fn_callback::fn_callback(void (*fn)(cc0::job&)) : m_fn(fn)
-{}
-
-void cc0::job::fn_callback::operator()(cc0::job &sender)
+// Allocates memory for pool chunks, aligned to at least POOL_CHUNK_SIZE.
+static void *page_allocate(uint64_t size, const void *call_site)
 {
-	if (m_fn != nullptr) {
-		m_fn(sender);
+	cc0::jobs_internal::check_allocation(size, call_site);
+#if defined(__linux__)
+	if (g_huge_pages || g_memory_node >= 0) {
+		void *p = MAP_FAILED;
+		if (g_huge_pages) {
+			p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0); // Aligned to the huge page size.
+		}
+		if (p == MAP_FAILED) { // No huge pages reserved by the system. Fall back to transparent huge pages if available.
+			p = map_aligned(size, g_huge_pages ? HUGE_PAGE_SIZE : POOL_CHUNK_SIZE);
+			if (p != MAP_FAILED && g_huge_pages) {
+				madvise(p, size, MADV_HUGEPAGE);
+			}
+		}
+		if (p != MAP_FAILED && g_memory_node >= 0) {
+			const unsigned long preferred = 1; // MPOL_PREFERRED
+			const unsigned long node_mask = 1UL << g_memory_node;
+			if (syscall(SYS_mbind, p, size, preferred, &node_mask, sizeof(node_mask) * 8, 0) != 0) { // The node does not exist or the kernel lacks NUMA support.
+				munmap(p, size);
+				p = MAP_FAILED;
+			}
+		}
+		if (p != MAP_FAILED) {
+			return p;
+		}
 	}
+#endif
+	return aligned_heap_allocate(size, POOL_CHUNK_SIZE);
 }
 
-//
-// callback
-//
-
-cc0::job::callback::callback( void ) : m_callback(nullptr)
-{}
+static void grow_pool(uint64_t index, const void *call_site)
+{
+	const uint64_t block_size = g_huge_pages ? HUGE_PAGE_SIZE : POOL_CHUNK_SIZE;
+	const uint64_t slot_size = (index + 1) * POOL_GRANULARITY;
+	const uint64_t slot_count = (POOL_CHUNK_SIZE - POOL_GRANULARITY) / slot_size;
+	pool_class &c = get_pool(index);
+	uint8_t *block = reinterpret_cast<uint8_t*>(page_allocate(block_size, call_site));
+	for (uint64_t offset = 0; offset < block_size; offset += POOL_CHUNK_SIZE) { // Huge pages are split into several chunks, each with its own header.
+		pool_chunk *chunk = reinterpret_cast<pool_chunk*>(block + offset);
+		chunk->next = c.chunks;
+		chunk->node = g_memory_node;
+		c.chunks = chunk;
+		for (uint64_t i = 0; i < slot_count; ++i) {
+			pool_slot *slot = reinterpret_cast<pool_slot*>(block + offset + POOL_GRANULARITY + i * slot_size);
+			slot->next = c.free;
+			c.free = slot;
+		}
+	}
+	c.free_count += slot_count * (block_size / POOL_CHUNK_SIZE);
+}
 
-cc0::job::callback::~callback( void )
+void cc0::jobs_internal::check_allocation(uint64_t size, const void *call_site)
 {
-	delete m_callback;
+	if (g_allocation_trap != nullptr && !g_inside_trap && cc0::jobs_internal::scratch_arena::current() != nullptr) {
+		g_inside_trap = true; // The trap itself may allocate memory.
+		g_allocation_trap(size, call_site);
+		g_inside_trap = false;
+	}
 }
 
-void cc0::job::callback::set(void (*fn)(job&))
+void *cc0::jobs_internal::allocate(uint64_t size)
 {
-	delete m_callback;
-	m_callback = new fn_callback(fn);
+	return allocate(size, CC0_JOBS_CALL_SITE);
 }
 
-void cc0::job::callback::operator()(cc0::job &sender)
+void *cc0::jobs_internal::allocate(uint64_t size, const void *call_site)
 {
-	if (m_callback != nullptr) {
-		(*m_callback)(sender);
+	const uint64_t index = pool_index(size);
+	if (index >= POOL_CLASSES) {
+		return heap_allocate(size, call_site);
+	}
+	pool_class &c = get_pool(index);
+	if (c.free == nullptr) {
+		grow_pool(index, call_site);
 	}
+	pool_slot *slot = c.free;
+	c.free = slot->next;
+	--c.free_count;
+	return slot;
 }
 
-//
-// result
-//
-
-cc0::job::query::result::result(cc0::job &j) : m_job(j.get_ref()), m_next(nullptr)
-{}
-
-cc0::job::query::result::~result( void )
+void cc0::jobs_internal::deallocate(void *p, uint64_t size)
 {
-	delete m_next;
-	m_next = nullptr;
+	if (p != nullptr) {
+		const uint64_t index = pool_index(size);
+		if (index >= POOL_CLASSES) {
+			std::free(p);
+		} else {
+			const pool_chunk *chunk = reinterpret_cast<const pool_chunk*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(POOL_CHUNK_SIZE - 1));
+			pool_class &c = g_pools[chunk->node + 1][index]; // Freed memory goes back to the pools of the node it was allocated for, regardless of the node of the calling thread.
+			pool_slot *slot = reinterpret_cast<pool_slot*>(p);
+			slot->next = c.free;
+			c.free = slot;
+			++c.free_count;
+		}
+	}
 }
 
-cc0::job::ref<> &cc0::job::query::result::get_job( void )
+void cc0::jobs_internal::reserve(uint64_t size, uint64_t count)
 {
-	return m_job;
+	const uint64_t index = pool_index(size);
+	if (index < POOL_CLASSES) {
+		while (get_pool(index).free_count < count) {
+			grow_pool(index, CC0_JOBS_CALL_SITE);
+		}
+	}
 }
 
-const cc0::job::ref<> &cc0::job::query::result::get_job( void ) const
+void cc0::jobs_internal::set_huge_pages(bool enable)
 {
-	return m_job;
+	g_huge_pages = enable;
 }
 
-cc0::job::query::result *cc0::job::query::result::get_next( void )
+bool cc0::jobs_internal::get_huge_pages( void )
 {
-	return m_next;
+	return g_huge_pages;
 }
 
-const cc0::job::query::result *cc0::job::query::result::get_next( void ) const
+bool cc0::jobs_internal::set_memory_node(int64_t node)
 {
-	return m_next;
+	if (node < -1 || node >= int64_t(POOL_NODES)) {
+		return false;
+	}
+	g_memory_node = node;
+	return true;
 }
 
-cc0::job::query::result *cc0::job::query::result::remove( void )
+int64_t cc0::jobs_internal::get_memory_node( void )
 {
-	cc0::job::query::result *next = m_next;
-	if (m_prev != nullptr) {
-		*m_prev = m_next;
-	}
-	m_next = nullptr;
-	delete this;
-	return next;
+	return g_memory_node;
 }
 
 //
-// results
+// components
 //
 
-void cc0::job::query::results::insert_and_increment(cc0::jobs_internal::search_tree<join_node,const cc0::job*> &t, cc0::job::query::results &r)
+static std::mutex g_components_mutex; // Protects the component pools, and the component slots of their owners, from jobs ticked in parallel.
+
+void cc0::jobs_internal::lock_components( void )
 {
-	result *i = r.get_results();
-	while (i != nullptr) {
-		join_node *n = t.get(i->get_job().get_job());
-		if (n != nullptr) {
-			++n->count;
-		} else {
-			t.add(i->get_job().get_job(), join_node{ i->get_job().get_job(), 1 });
-		}
-		i = i->get_next();
-	}
+	g_components_mutex.lock();
 }
 
-void cc0::job::query::results::remove_and_decrement(cc0::jobs_internal::search_tree<join_node,const cc0::job*> &t, cc0::job::query::results &r)
+void cc0::jobs_internal::unlock_components( void )
 {
-	result *i = r.get_results();
-	while (i != nullptr) {
-		join_node *n = t.get(i->get_job().get_job());
-		if (n != nullptr) {
-			--n->count;
-		}
-		i = i->get_next();
-	}
+	g_components_mutex.unlock();
 }
 
-cc0::job::query::results::results( void ) : m_first(nullptr), m_end(&m_first)
-{}
+//
+// pooled
+//
 
-cc0::job::query::results::~results( void )
+void *cc0::jobs_internal::pooled::operator new(std::size_t size)
 {
-	delete m_first;
+	return cc0::jobs_internal::allocate(size, CC0_JOBS_CALL_SITE); // Captured here, since it refers to the new-expression.
 }
 
-cc0::job::query::results::results(cc0::job::query::results &&r) : results()
+void cc0::jobs_internal::pooled::operator delete(void *p, std::size_t size)
 {
-	m_first = r.m_first;
-	m_end = r.m_end;
-
-	r.m_first = nullptr;
-	r.m_end = &r.m_first;
+	cc0::jobs_internal::deallocate(p, size);
 }
 
-cc0::job::query::results &cc0::job::query::results::operator=(cc0::job::query::results &&r)
+//
+// scratch_arena
+//
+
+#define SCRATCH_BLOCK_SIZE (64ULL * 1024ULL)
+
+cc0::jobs_internal::scratch_arena::block *cc0::jobs_internal::scratch_arena::new_block(uint64_t size)
 {
-	if (this != &r) {
-		delete m_first;
-		
-		m_first = r.m_first;
-		m_end   = r.m_end;
-		
-		r.m_first = nullptr;
-		r.m_end = &r.m_first;
+	size = size > SCRATCH_BLOCK_SIZE ? size : SCRATCH_BLOCK_SIZE;
+	block *b = reinterpret_cast<block*>(heap_allocate(sizeof(block) + size, CC0_JOBS_CALL_SITE));
+	b->size = size;
+	b->used = 0;
+	if (m_current != nullptr) {
+		b->next = m_current->next;
+		m_current->next = b;
+	} else {
+		b->next = m_first;
+		m_first = b;
 	}
-	
-	return *this;
+	return b;
 }
 
-cc0::job::query::result *cc0::job::query::results::get_results( void )
+cc0::jobs_internal::scratch_arena::scratch_arena( void ) : m_first(nullptr), m_current(nullptr), m_depth(0), m_borrowed(nullptr), m_loans(0), m_lent(false)
+{}
+
+cc0::jobs_internal::scratch_arena::~scratch_arena( void )
 {
-	return m_first;
+	while (m_first != nullptr) {
+		block *next = m_first->next;
+		std::free(m_first);
+		m_first = next;
+	}
 }
 
-const cc0::job::query::result *cc0::job::query::results::get_results( void ) const
+void *cc0::jobs_internal::scratch_arena::allocate(uint64_t size, uint64_t align)
 {
-	return m_first;
+	// Blocks are only ever reused in order after a reset, so any free space is found at or after the current block.
+	while (m_current != nullptr) {
+		const uint64_t base = uint64_t(reinterpret_cast<uintptr_t>(m_current + 1));
+		const uint64_t start = (base + m_current->used + align - 1) & ~(align - 1);
+		if (start + size <= base + m_current->size) {
+			m_current->used = start + size - base;
+			return reinterpret_cast<void*>(uintptr_t(start));
+		}
+		if (m_current->next == nullptr) {
+			break;
+		}
+		m_current = m_current->next;
+	}
+	m_current = new_block(size + align);
+	return allocate(size, align);
 }
 
-uint64_t cc0::job::query::results::count_results( void ) const
+void cc0::jobs_internal::scratch_arena::reset( void )
 {
-	const result *r = m_first;
-	uint64_t c = 0;
-	while (r != nullptr) {
-		++c;
-		r = r->get_next();
+	for (block *b = m_first; b != nullptr; b = b->next) {
+		b->used = 0;
 	}
-	return c;
+	m_current = m_first;
+	m_lent = false;
 }
 
-void cc0::job::query::results::add_result(cc0::job &j)
+void cc0::jobs_internal::scratch_arena::enter( void )
 {
-	*m_end = new query::result(j);
-	m_end = &(*m_end)->m_next;
+	if (m_depth == 0 && m_lent && CC0_JOBS_ATOMIC_LOAD(m_loans) == 0) {
+		reset(); // The root cycles that used the arena on other threads have all ended since the arena was last used.
+	}
+	++m_depth;
 }
 
-cc0::job::query::results cc0::job::query::results::filter_results(const cc0::job::query &q)
+void cc0::jobs_internal::scratch_arena::leave( void )
 {
-	results r;
-	result *c = get_results();
-	while (c != nullptr) {
-		if (q(*c->get_job().get_job())) {
-			r.add_result(*c->get_job().get_job());
+	if (m_depth > 0 && --m_depth == 0) {
+		// The list lives in this arena, so it is walked before the arena is reset.
+		for (loan *l = m_borrowed; l != nullptr; l = l->next) {
+			CC0_JOBS_ATOMIC_SUB(l->arena->m_loans, 1);
+		}
+		m_borrowed = nullptr;
+		if (CC0_JOBS_ATOMIC_LOAD(m_loans) == 0) {
+			reset();
 		}
-		c = c->get_next();
 	}
-	return r;
 }
 
-cc0::job::query::results cc0::job::query::results::join_and(cc0::job::query::results &a, cc0::job::query::results &b)
+void cc0::jobs_internal::scratch_arena::lend( void )
 {
-	cc0::jobs_internal::search_tree<join_node,const job*> t;
-	insert_and_increment(t, a);
-	insert_and_increment(t, b);
-	results res;
-	struct accum
-	{
-		results *r;
-		accum(results *res) : r(res) {}
-		void operator()(join_node &n) {
-			if (n.count >= 2) {
-				r->add_result(*n.value);
-			}
-		}
-	} fn(&res);
-	t.traverse(fn);
-	return res;
+	CC0_JOBS_ATOMIC_ADD(m_loans, 1);
+	m_lent = true;
 }
 
-cc0::job::query::results cc0::job::query::results::join_or(cc0::job::query::results &a, cc0::job::query::results &b)
+void cc0::jobs_internal::scratch_arena::borrow(cc0::jobs_internal::scratch_arena &arena)
 {
-	cc0::jobs_internal::search_tree<join_node,const job*> t;
-	insert_and_increment(t, a);
-	insert_and_increment(t, b);
-	results res;
-	struct accum
-	{
-		results *r;
-		accum(results *res) : r(res) {}
-		void operator()(join_node &n) {
-			r->add_result(*n.value);
-		}
-	} fn(&res);
-	t.traverse(fn);
-	return res;
+	loan *l = reinterpret_cast<loan*>(allocate(sizeof(loan), alignof(loan)));
+	l->arena = &arena;
+	l->next = m_borrowed;
+	m_borrowed = l;
 }
 
-cc0::job::query::results cc0::job::query::results::join_sub(cc0::job::query::results &l, cc0::job::query::results &r)
+bool cc0::jobs_internal::scratch_arena::is_outermost( void ) const
 {
-	cc0::jobs_internal::search_tree<join_node,const job*> t;
-	insert_and_increment(t, l);
-	remove_and_decrement(t, r);
-	results res;
-	struct accum
-	{
-		results *r;
-		accum(results *res) : r(res) {}
-		void operator()(join_node &n) {
-			if (n.count == 1) {
-				r->add_result(*n.value);
-			}
-		}
-	} fn(&res);
-	t.traverse(fn);
-	return res;
+	return m_depth == 1;
 }
 
-cc0::job::query::results cc0::job::query::results::join_xor(cc0::job::query::results &a, cc0::job::query::results &b)
+cc0::jobs_internal::scratch_arena &cc0::jobs_internal::scratch_arena::instance( void )
 {
-	cc0::jobs_internal::search_tree<join_node,const job*> t;
-	insert_and_increment(t, a);
-	insert_and_increment(t, b);
-	results res;
-	struct accum
+	// An arena that is still lent to a root cycle when its thread exits is leaked rather than invalidating the memory of that root cycle.
+	struct arena_owner
 	{
-		results *r;
-		accum(results *res) : r(res) {}
-		void operator()(join_node &n) {
-			if (n.count == 1) {
-				r->add_result(*n.value);
+		scratch_arena *arena;
+		arena_owner( void ) : arena(new (std::malloc(sizeof(scratch_arena))) scratch_arena) {}
+		~arena_owner( void )
+		{
+			if (CC0_JOBS_ATOMIC_LOAD(arena->m_loans) == 0) {
+				arena->~scratch_arena();
+				std::free(arena);
 			}
 		}
-	} fn(&res);
-	t.traverse(fn);
-	return res;
+	};
+	static thread_local arena_owner owner;
+	return *owner.arena;
 }
 
-//
-// query
-//
-
-cc0::job::query::~query( void )
-{}
-
-bool cc0::job::query::operator()(const cc0::job &j) const
+cc0::jobs_internal::scratch_arena *cc0::jobs_internal::scratch_arena::current( void )
 {
-	return true;
+	scratch_arena &a = instance();
+	return a.m_depth > 0 ? &a : nullptr;
 }
 
 //
-// job
+// buffered_base
 //
 
-cc0::jobs_internal::search_tree<cc0::jobs_internal::instance_fn> cc0::job::m_products = cc0::jobs_internal::search_tree<cc0::jobs_internal::instance_fn>();
+static std::mutex                         g_buffered_mutex;         // Protects the list of written values, which may be written to from several threads.
+static cc0::jobs_internal::buffered_base *g_buffered_list = nullptr; // The values written to since the last commit.
 
-void cc0::job::set_deleted( void )
+void cc0::jobs_internal::buffered_base::link( void )
 {
-	m_shared->deleted = true;
+	std::lock_guard<std::mutex> lock(g_buffered_mutex);
+	m_prev = nullptr;
+	m_next = g_buffered_list;
+	if (g_buffered_list != nullptr) {
+		g_buffered_list->m_prev = this;
+	}
+	g_buffered_list = this;
+	m_dirty = true;
 }
 
-void cc0::job::add_sibling(cc0::job *&loc, cc0::job *p)
+void cc0::jobs_internal::buffered_base::unlink( void )
 {
-	cc0::job *old_loc = loc;
-	loc = p;
-	loc->m_parent = this;
+	std::lock_guard<std::mutex> lock(g_buffered_mutex);
+	if (m_prev != nullptr) {
+		m_prev->m_next = m_next;
+	} else {
+		g_buffered_list = m_next;
+	}
+	if (m_next != nullptr) {
+		m_next->m_prev = m_prev;
+	}
+	m_prev = m_next = nullptr;
+	m_dirty = false;
+}
+
+cc0::jobs_internal::buffered_base::buffered_base( void ) : m_prev(nullptr), m_next(nullptr), m_dirty(false)
+{}
+
+cc0::jobs_internal::buffered_base::buffered_base(const cc0::jobs_internal::buffered_base &b) : m_prev(nullptr), m_next(nullptr), m_dirty(false)
+{
+	if (b.m_dirty) {
+		link(); // The list links are never copied, only the fact that there is a write to commit.
+	}
+}
+
+cc0::jobs_internal::buffered_base::~buffered_base( void )
+{
+	if (m_dirty) {
+		unlink();
+	}
+}
+
+cc0::jobs_internal::buffered_base &cc0::jobs_internal::buffered_base::operator=(const cc0::jobs_internal::buffered_base &b)
+{
+	if (b.m_dirty) {
+		mark_dirty();
+	}
+	return *this;
+}
+
+void cc0::jobs_internal::buffered_base::mark_dirty( void )
+{
+	// Only the first write per cycle takes the lock. A value is only written by one thread per cycle, so the flag does not need to be atomic.
+	if (!m_dirty) {
+		link();
+	}
+}
+
+void cc0::jobs_internal::buffered_base::commit_all( void )
+{
+	std::lock_guard<std::mutex> lock(g_buffered_mutex);
+	while (g_buffered_list != nullptr) {
+		buffered_base *b = g_buffered_list;
+		g_buffered_list = b->m_next;
+		b->m_prev = b->m_next = nullptr;
+		b->m_dirty = false;
+		b->commit();
+	}
+}
+
+//
+// worker_pool
+//
+
+#define RANGE_BITS 32ULL
+#define RANGE_MASK ((1ULL << RANGE_BITS) - 1ULL)
+
+static thread_local bool g_inside_parallel = false; // Nested parallel loops run serially on the calling thread.
+
+// The chunks a thread still has to execute. The thread takes chunks from the front, while other threads steal from the back.
+struct steal_range
+{
+	std::atomic<uint64_t> range;                                  // The first chunk in the low bits, and one past the last chunk in the high bits.
+	uint8_t               padding[CACHE_LINE - sizeof(uint64_t)]; // Ranges are written by different threads, so they are kept on separate cache lines.
+};
+
+struct worker_pool
+{
+	std::thread                      *threads;
+	steal_range                      *ranges; // One per worker thread, and one for the calling thread.
+	uint64_t                          count;
+	std::atomic<bool>                 started; // Read without locking, once the pool has been started.
+	bool                              stop;
+	std::mutex                        call_mutex; // Only one parallel loop runs on the pool at a time.
+	std::mutex                        mutex;
+	std::condition_variable           wake;
+	std::condition_variable           idle;
+	uint64_t                          generation;
+	uint64_t                          busy;
+	cc0::jobs_internal::parallel_fn   fn;
+	void                             *context;
+	bool                              lanes;
+	uint64_t                          begin;
+	uint64_t                          end;
+	uint64_t                          grain;
+	uint64_t                          chunks;
+	std::atomic<uint64_t>             done;
+	std::exception_ptr                failure; // The first exception thrown by a chunk, rethrown on the calling thread.
+	std::atomic<bool>                 failed;
+
+	worker_pool( void ) : threads(nullptr), ranges(nullptr), count(0), started(false), stop(false), generation(0), busy(0), fn(nullptr), context(nullptr), lanes(false), begin(0), end(0), grain(1), chunks(0), done(0), failure(), failed(false) {}
+	~worker_pool( void ) { shut_down(); }
+
+	void call(uint64_t chunk, uint64_t b, uint64_t e)
+	{
+		// An exception must not escape a worker thread, and the calling thread must not leave while workers still use the loop, so it is passed on after the loop.
+		if (!failed.load()) {
+			try {
+				fn(context, chunk, b, e);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!failed.exchange(true)) {
+					failure = std::current_exception();
+				}
+			}
+		}
+		done.fetch_add(1);
+	}
+
+	static uint64_t pack(uint64_t first, uint64_t last)
+	{
+		return first | (last << RANGE_BITS);
+	}
+
+	bool take(uint64_t self, uint64_t &chunk)
+	{
+		std::atomic<uint64_t> &own = ranges[self].range;
+		uint64_t r = own.load();
+		while ((r & RANGE_MASK) < (r >> RANGE_BITS)) {
+			if (own.compare_exchange_weak(r, r + 1)) {
+				chunk = r & RANGE_MASK;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool steal(uint64_t self)
+	{
+		// The back half of the first range found that is not empty is moved to the own range, which is empty, so no other thread writes to it meanwhile.
+		for (uint64_t i = 1; i <= count; ++i) {
+			std::atomic<uint64_t> &victim = ranges[(self + i) % (count + 1)].range;
+			uint64_t r = victim.load();
+			while ((r & RANGE_MASK) < (r >> RANGE_BITS)) {
+				const uint64_t first = r & RANGE_MASK;
+				const uint64_t last = r >> RANGE_BITS;
+				const uint64_t split = last - (last - first + 1) / 2;
+				if (victim.compare_exchange_weak(r, pack(first, split))) {
+					ranges[self].range.store(pack(split, last));
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void work(uint64_t self)
+	{
+		// Every thread starts on its own contiguous share of the chunks, and threads that run out steal half of what another thread has left.
+		uint64_t c = 0;
+		while (take(self, c) || (steal(self) && take(self, c))) {
+			const uint64_t b = begin + c * grain;
+			call(c, b, end - b > grain ? b + grain : end);
+		}
+	}
+
+	void work_lane(uint64_t lane)
+	{
+		if (lane < chunks) {
+			call(lane, 0, 0);
+		}
+	}
+
+	void loop(uint64_t index, uint64_t seen)
+	{
+		g_inside_parallel = true;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [&]{ return stop || generation != seen; });
+			if (stop) {
+				break;
+			}
+			seen = generation;
+			++busy;
+			lock.unlock();
+			if (lanes) {
+				work_lane(index + 1);
+			} else {
+				work(index + 1);
+			}
+			lock.lock();
+			if (--busy == 0) {
+				idle.notify_all();
+			}
+		}
+	}
+
+	void start(uint64_t n)
+	{
+		shut_down();
+		count = n;
+		threads = count > 0 ? new std::thread[count] : nullptr;
+		ranges = new steal_range[count + 1];
+		for (uint64_t i = 0; i <= count; ++i) {
+			ranges[i].range.store(0);
+		}
+		for (uint64_t i = 0; i < count; ++i) {
+			threads[i] = std::thread(&worker_pool::loop, this, i, generation); // Pass the generation rather than reading it on the thread, which could miss the first loop.
+		}
+		started = true;
+	}
+
+	void shut_down( void )
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (uint64_t i = 0; i < count; ++i) {
+			threads[i].join();
+		}
+		delete [] threads;
+		threads = nullptr;
+		delete [] ranges;
+		ranges = nullptr;
+		count = 0;
+		started = false;
+		stop = false;
+	}
+
+	void run(uint64_t b, uint64_t e, uint64_t g, cc0::jobs_internal::parallel_fn f, void *ctx, bool l)
+	{
+		std::lock_guard<std::mutex> call_lock(call_mutex);
+		{
+			// Workers that woke up too late for the previous loop may still be reading it.
+			std::unique_lock<std::mutex> lock(mutex);
+			idle.wait(lock, [&]{ return busy == 0; });
+			fn = f;
+			context = ctx;
+			lanes = l;
+			begin = b;
+			end = e;
+			grain = g;
+			chunks = lanes ? e - b : (e - b + g - 1) / g;
+			for (uint64_t i = 0; i <= count; ++i) {
+				ranges[i].range.store(lanes ? 0 : pack(chunks * i / (count + 1), chunks * (i + 1) / (count + 1)));
+			}
+			done.store(0);
+			failure = nullptr;
+			failed.store(false);
+			++generation;
+		}
+		wake.notify_all();
+		g_inside_parallel = true;
+		if (lanes) {
+			work_lane(0);
+		} else {
+			work(0); // The calling thread helps rather than idling.
+		}
+		g_inside_parallel = false;
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [&]{ return busy == 0 && done.load() == chunks; });
+		if (failed.load()) {
+			std::exception_ptr e = failure;
+			failure = nullptr;
+			lock.unlock();
+			std::rethrow_exception(e);
+		}
+	}
+
+	static worker_pool &instance( void )
+	{
+		static worker_pool pool;
+		return pool;
+	}
+};
+
+uint64_t cc0::jobs_internal::parallel_grain(uint64_t count, uint64_t grain)
+{
+	if (grain == 0) {
+		// Several chunks per thread let threads that finish early take over the work of threads that are slowed down.
+		const uint64_t target_chunks = (get_worker_count() + 1) * 4;
+		grain = (count + target_chunks - 1) / target_chunks;
+	}
+	const uint64_t min_grain = count / RANGE_MASK + 1; // The chunk indices must fit in the ranges that threads steal from.
+	return grain > min_grain ? grain : min_grain;
+}
+
+void cc0::jobs_internal::parallel_range(uint64_t begin, uint64_t end, uint64_t grain, cc0::jobs_internal::parallel_fn fn, void *context)
+{
+	if (begin >= end) {
+		return;
+	}
+	grain = parallel_grain(end - begin, grain);
+	worker_pool &pool = worker_pool::instance();
+	if (g_inside_parallel || end - begin <= grain || get_worker_count() == 0) {
+		for (uint64_t c = 0, b = begin; b < end; ++c, b += grain) {
+			fn(context, c, b, end - b > grain ? b + grain : end);
+		}
+		return;
+	}
+	pool.run(begin, end, grain, fn, context, false);
+}
+
+void cc0::jobs_internal::parallel_lanes(uint64_t lanes, cc0::jobs_internal::parallel_fn fn, void *context)
+{
+	const uint64_t workers = get_worker_count();
+	lanes = lanes <= workers + 1 ? lanes : workers + 1;
+	if (g_inside_parallel || lanes <= 1) {
+		for (uint64_t l = 0; l < lanes; ++l) {
+			fn(context, l, 0, 0);
+		}
+		return;
+	}
+	worker_pool::instance().run(0, lanes, 1, fn, context, true);
+}
+
+#if defined(__linux__)
+static bool get_lane_thread(uint64_t lane, std::thread::native_handle_type &thread)
+{
+	if (lane == 0) {
+		thread = pthread_self();
+		return true;
+	}
+	worker_pool &pool = worker_pool::instance();
+	if (lane > cc0::jobs_internal::get_worker_count()) {
+		return false;
+	}
+	thread = pool.threads[lane - 1].native_handle();
+	return true;
+}
+#endif
+
+bool cc0::jobs_internal::set_lane_cpu(uint64_t lane, int64_t cpu)
+{
+#if defined(__linux__)
+	std::thread::native_handle_type thread;
+	if (get_lane_thread(lane, thread)) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (cpu >= 0) {
+			if (cpu >= CPU_SETSIZE) {
+				return false;
+			}
+			CPU_SET(cpu, &set);
+		} else {
+			for (int i = 0; i < CPU_SETSIZE; ++i) {
+				CPU_SET(i, &set);
+			}
+		}
+		return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+	}
+#endif
+	return false;
+}
+
+bool cc0::jobs_internal::set_lane_realtime_priority(uint64_t lane, int64_t priority)
+{
+#if defined(__linux__)
+	std::thread::native_handle_type thread;
+	if (get_lane_thread(lane, thread)) {
+		sched_param param;
+		param.sched_priority = int(priority);
+		return pthread_setschedparam(thread, priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param) == 0;
+	}
+#endif
+	return false;
+}
+
+void cc0::jobs_internal::set_worker_count(uint64_t count)
+{
+	worker_pool &pool = worker_pool::instance();
+	std::lock_guard<std::mutex> call_lock(pool.call_mutex);
+	pool.start(count);
+}
+
+uint64_t cc0::jobs_internal::get_worker_count( void )
+{
+	worker_pool &pool = worker_pool::instance();
+	if (!pool.started) {
+		std::lock_guard<std::mutex> call_lock(pool.call_mutex);
+		if (!pool.started) {
+			const uint64_t hardware = std::thread::hardware_concurrency();
+			pool.start(hardware > 1 ? hardware - 1 : 0);
+		}
+	}
+	return pool.count;
+}
+
+//
+// event_queue
+//
+
+struct queued_event
+{
+	const char      *event;
+	cc0::job::ref<>  sender;
+	cc0::job::ref<>  target;
+	uint64_t         target_id;
+	uint64_t         payload_type;
+	uint64_t         payload_offset;
+	bool             has_payload;
+	bool             coalesce;
+};
+
+struct event_queue
+{
+	queued_event *events;
+	uint64_t      count;
+	uint64_t      capacity;
+	uint8_t      *payloads;         // Event data is copied here so that it can be delivered by value after the sender has moved on.
+	uint64_t      payload_size;
+	uint64_t      payload_capacity;
+
+	event_queue( void ) : events(nullptr), count(0), capacity(0), payloads(nullptr), payload_size(0), payload_capacity(0) {}
+	~event_queue( void ) { clear(); cc0::jobs_internal::deallocate(events, sizeof(queued_event) * capacity); cc0::jobs_internal::deallocate(payloads, payload_capacity); }
+
+	uint64_t copy_payload(const void *data, uint64_t size, uint64_t align)
+	{
+		align = align > 0 ? align : 1;
+		const uint64_t offset = (payload_size + align - 1) & ~(align - 1);
+		if (offset + size > payload_capacity) {
+			uint64_t new_capacity = payload_capacity > 0 ? payload_capacity * 2 : 1024;
+			while (new_capacity < offset + size) {
+				new_capacity *= 2;
+			}
+			uint8_t *new_payloads = reinterpret_cast<uint8_t*>(cc0::jobs_internal::allocate(new_capacity)); // Aligned to CC0_JOBS_MAX_PAYLOAD_ALIGN, so offsets aligned within the buffer are aligned in memory.
+			if (payloads != nullptr) {
+				std::memcpy(new_payloads, payloads, payload_size);
+			}
+			cc0::jobs_internal::deallocate(payloads, payload_capacity);
+			payloads = new_payloads;
+			payload_capacity = new_capacity;
+		}
+		std::memcpy(payloads + offset, data, size);
+		payload_size = offset + size;
+		return offset;
+	}
+
+	void push(const char *event, cc0::job &sender, cc0::job &target, bool coalesce, const cc0::job::payload &data)
+	{
+		if (count == capacity) {
+			const uint64_t new_capacity = capacity > 0 ? capacity * 2 : 64;
+			queued_event *new_events = reinterpret_cast<queued_event*>(cc0::jobs_internal::allocate(sizeof(queued_event) * new_capacity));
+			for (uint64_t i = 0; i < count; ++i) {
+				new (new_events + i) queued_event(static_cast<queued_event&&>(events[i]));
+				events[i].~queued_event();
+			}
+			cc0::jobs_internal::deallocate(events, sizeof(queued_event) * capacity);
+			events = new_events;
+			capacity = new_capacity;
+		}
+		queued_event &e = *new (events + count++) queued_event;
+		e.event = event;
+		e.sender = sender.get_ref();
+		e.target = target.get_ref();
+		e.target_id = target.get_job_id();
+		e.payload_type = data.type;
+		e.has_payload = data.data != nullptr;
+		e.payload_offset = e.has_payload ? copy_payload(data.data, data.size, data.align) : 0;
+		e.coalesce = coalesce;
+	}
+
+	cc0::job::payload get_payload(const queued_event &e) const
+	{
+		return cc0::job::payload{ e.has_payload ? payloads + e.payload_offset : nullptr, e.payload_type, 0, 0 };
+	}
+
+	void clear( void )
+	{
+		for (uint64_t i = 0; i < count; ++i) {
+			events[i].~queued_event();
+		}
+		count = 0;
+		payload_size = 0;
+	}
+
+	void append(event_queue &q)
+	{
+		if (q.count == 0) {
+			return;
+		}
+		const uint64_t base = q.payload_size > 0 ? copy_payload(q.payloads, q.payload_size, 16) : 0;
+		for (uint64_t i = 0; i < q.count; ++i) {
+			cc0::job *sender = q.events[i].sender.get_job();
+			cc0::job *target = q.events[i].target.get_job();
+			if (sender != nullptr && target != nullptr) {
+				push(q.events[i].event, *sender, *target, q.events[i].coalesce, cc0::job::payload{ nullptr, q.events[i].payload_type, 0, 0 });
+				events[count - 1].has_payload = q.events[i].has_payload;
+				events[count - 1].payload_offset = q.events[i].payload_offset + base;
+			}
+		}
+		q.clear();
+	}
+
+	void cancel(uint64_t first, uint64_t last)
+	{
+		for (uint64_t i = first; i < last && i < count; ++i) {
+			events[i].target.release(); // Events without a target are skipped.
+		}
+	}
+
+	void swap(event_queue &q)
+	{
+		queued_event *e = events; events = q.events; q.events = e;
+		uint64_t n = count; count = q.count; q.count = n;
+		uint64_t c = capacity; capacity = q.capacity; q.capacity = c;
+		uint8_t *p = payloads; payloads = q.payloads; q.payloads = p;
+		n = payload_size; payload_size = q.payload_size; q.payload_size = n;
+		c = payload_capacity; payload_capacity = q.payload_capacity; q.payload_capacity = c;
+	}
+};
+
+static thread_local event_queue g_event_queue;
+static thread_local event_queue g_spare_queue;          // Keeps the storage of the previous batch for reuse. Taken while dispatching so that nested dispatches use their own storage.
+static thread_local uint64_t    g_delivered_events = 0; // The number of events in the most recent batch delivered on the thread.
+
+static uint64_t event_key(const char *event, uint64_t sender_id)
+{
+	uint64_t sum = 0xcbf29ce484222325ULL ^ sender_id;
+	for (uint64_t i = 0; event[i] != 0; ++i) {
+		sum ^= uint64_t(event[i]);
+		sum *= 0x100000001b3ULL;
+	}
+	return sum;
+}
+
+static bool event_equal(const char *a, const char *b)
+{
+	while (*a != 0 && *a == *b) {
+		++a;
+		++b;
+	}
+	return *a == *b;
+}
+
+// Determines if two events would be delivered identically, barring their data.
+static bool same_event(const queued_event &a, const queued_event &b)
+{
+	return a.sender.get_job() == b.sender.get_job() && a.payload_type == b.payload_type && event_equal(a.event, b.event);
+}
+
+/// Stable merge sort of event indices by target so that each target handles all of its events at once.
+static void sort_events(const queued_event *events, uint64_t *order, uint64_t *temp, uint64_t count)
+{
+	for (uint64_t width = 1; width < count; width *= 2) {
+		for (uint64_t begin = 0; begin < count; begin += 2 * width) {
+			const uint64_t mid = begin + width < count ? begin + width : count;
+			const uint64_t end = begin + 2 * width < count ? begin + 2 * width : count;
+			uint64_t l = begin, r = mid, o = begin;
+			while (l < mid && r < end) {
+				temp[o++] = events[order[r]].target_id < events[order[l]].target_id ? order[r++] : order[l++];
+			}
+			while (l < mid) { temp[o++] = order[l++]; }
+			while (r < end) { temp[o++] = order[r++]; }
+		}
+		for (uint64_t i = 0; i < count; ++i) {
+			order[i] = temp[i];
+		}
+	}
+}
+
+//
+// rtti
+//
+
+void *cc0::jobs_internal::rtti::self(uint64_t type_id)
+{
+	return this->type_id() == type_id ? this : nullptr;
+}
+
+const void *cc0::jobs_internal::rtti::self(uint64_t type_id) const
+{
+	return this->type_id() == type_id ? this : nullptr;
+}
+
+cc0::jobs_internal::rtti::~rtti( void )
+{}
+
+uint64_t cc0::jobs_internal::rtti::type_id( void )
+{
+	static const uint64_t id = cc0::jobs_internal::new_uuid();
+	return id;
+}
+
+cc0::jobs_internal::rtti *cc0::jobs_internal::rtti::instance( void )
+{
+	return new rtti;
+}
+
+uint64_t cc0::jobs_internal::rtti::object_id( void ) const
+{
+	return type_id();
+}
+
+const char *cc0::jobs_internal::rtti::object_name( void ) const
+{
+	return type_name();
+}
+
+const char *cc0::jobs_internal::rtti::type_name( void )
+{
+	return "rtti";
+}
+
+//
+// shared
+//
+
+cc0::job::shared::shared( void ) : watchers(1), deleted(false), completed(false), result{ nullptr, 0, 0, 0 }, waiters(nullptr)
+{}
+
+cc0::job::shared::~shared( void )
+{
+	set_result(payload{ nullptr, 0, 0, 0 });
+	while (waiters != nullptr) {
+		completion_waiter *w = waiters;
+		waiters = w->next;
+		delete w;
+	}
+}
+
+void cc0::job::shared::set_result(const cc0::job::payload &data)
+{
+	if (result.data != nullptr) {
+		cc0::jobs_internal::deallocate(const_cast<void*>(result.data), result.size);
+	}
+	result = data;
+	if (data.data != nullptr) {
+		void *p = cc0::jobs_internal::allocate(data.size);
+		std::memcpy(p, data.data, data.size);
+		result.data = p;
+	}
+}
+
+//
+// fn_callback
+//
+
+cc0::job::fn_callback::fn_callback(void (*fn)(cc0::job&)) : m_fn(fn)
+{}
+
+void cc0::job::fn_callback::operator()(cc0::job&, cc0::job &sender, const cc0::job::payload&)
+{
+	if (m_fn != nullptr) {
+		m_fn(sender);
+	}
+}
+
+//
+// callback
+//
+
+cc0::job::callback::callback( void ) : m_callback(nullptr)
+{}
+
+cc0::job::callback::~callback( void )
+{
+	delete m_callback;
+}
+
+void cc0::job::callback::set(void (*fn)(job&))
+{
+	delete m_callback;
+	m_callback = new fn_callback(fn);
+}
+
+void cc0::job::callback::operator()(cc0::job &receiver, cc0::job &sender, const cc0::job::payload &data)
+{
+	if (m_callback != nullptr) {
+		(*m_callback)(receiver, sender, data);
+	}
+}
+
+//
+// result
+//
+
+cc0::job::query::result::result(cc0::job &j) : m_job(j.get_ref()), m_next(nullptr)
+{}
+
+cc0::job::query::result::~result( void )
+{
+	delete m_next;
+	m_next = nullptr;
+}
+
+cc0::job::ref<> &cc0::job::query::result::get_job( void )
+{
+	return m_job;
+}
+
+const cc0::job::ref<> &cc0::job::query::result::get_job( void ) const
+{
+	return m_job;
+}
+
+cc0::job::query::result *cc0::job::query::result::get_next( void )
+{
+	return m_next;
+}
+
+const cc0::job::query::result *cc0::job::query::result::get_next( void ) const
+{
+	return m_next;
+}
+
+cc0::job::query::result *cc0::job::query::result::remove( void )
+{
+	cc0::job::query::result *next = m_next;
+	if (m_prev != nullptr) {
+		*m_prev = m_next;
+	}
+	m_next = nullptr;
+	delete this;
+	return next;
+}
+
+//
+// results
+//
+
+void cc0::job::query::results::insert_and_increment(cc0::jobs_internal::search_tree<join_node,const cc0::job*> &t, cc0::job::query::results &r)
+{
+	result *i = r.get_results();
+	while (i != nullptr) {
+		join_node *n = t.get(i->get_job().get_job());
+		if (n != nullptr) {
+			++n->count;
+		} else {
+			t.add(i->get_job().get_job(), join_node{ i->get_job().get_job(), 1 });
+		}
+		i = i->get_next();
+	}
+}
+
+void cc0::job::query::results::remove_and_decrement(cc0::jobs_internal::search_tree<join_node,const cc0::job*> &t, cc0::job::query::results &r)
+{
+	result *i = r.get_results();
+	while (i != nullptr) {
+		join_node *n = t.get(i->get_job().get_job());
+		if (n != nullptr) {
+			--n->count;
+		}
+		i = i->get_next();
+	}
+}
+
+cc0::job::query::results::results( void ) : m_first(nullptr), m_end(&m_first)
+{}
+
+cc0::job::query::results::~results( void )
+{
+	delete m_first;
+}
+
+cc0::job::query::results::results(cc0::job::query::results &&r) : results()
+{
+	m_first = r.m_first;
+	m_end = r.m_end;
+
+	r.m_first = nullptr;
+	r.m_end = &r.m_first;
+}
+
+cc0::job::query::results &cc0::job::query::results::operator=(cc0::job::query::results &&r)
+{
+	if (this != &r) {
+		delete m_first;
+		
+		m_first = r.m_first;
+		m_end   = r.m_end;
+		
+		r.m_first = nullptr;
+		r.m_end = &r.m_first;
+	}
+	
+	return *this;
+}
+
+cc0::job::query::result *cc0::job::query::results::get_results( void )
+{
+	return m_first;
+}
+
+const cc0::job::query::result *cc0::job::query::results::get_results( void ) const
+{
+	return m_first;
+}
+
+uint64_t cc0::job::query::results::count_results( void ) const
+{
+	const result *r = m_first;
+	uint64_t c = 0;
+	while (r != nullptr) {
+		++c;
+		r = r->get_next();
+	}
+	return c;
+}
+
+void cc0::job::query::results::add_result(cc0::job &j)
+{
+	*m_end = new query::result(j);
+	m_end = &(*m_end)->m_next;
+}
+
+cc0::job::query::results cc0::job::query::results::filter_results(const cc0::job::query &q)
+{
+	results r;
+	result *c = get_results();
+	while (c != nullptr) {
+		if (q(*c->get_job().get_job())) {
+			r.add_result(*c->get_job().get_job());
+		}
+		c = c->get_next();
+	}
+	return r;
+}
+
+cc0::job::query::results cc0::job::query::results::join_and(cc0::job::query::results &a, cc0::job::query::results &b)
+{
+	cc0::jobs_internal::search_tree<join_node,const job*> t(cc0::jobs_internal::scratch_arena::current());
+	insert_and_increment(t, a);
+	insert_and_increment(t, b);
+	results res;
+	struct accum
+	{
+		results *r;
+		accum(results *res) : r(res) {}
+		void operator()(join_node &n) {
+			if (n.count >= 2) {
+				r->add_result(*n.value);
+			}
+		}
+	} fn(&res);
+	t.traverse(fn);
+	return res;
+}
+
+cc0::job::query::results cc0::job::query::results::join_or(cc0::job::query::results &a, cc0::job::query::results &b)
+{
+	cc0::jobs_internal::search_tree<join_node,const job*> t(cc0::jobs_internal::scratch_arena::current());
+	insert_and_increment(t, a);
+	insert_and_increment(t, b);
+	results res;
+	struct accum
+	{
+		results *r;
+		accum(results *res) : r(res) {}
+		void operator()(join_node &n) {
+			r->add_result(*n.value);
+		}
+	} fn(&res);
+	t.traverse(fn);
+	return res;
+}
+
+cc0::job::query::results cc0::job::query::results::join_sub(cc0::job::query::results &l, cc0::job::query::results &r)
+{
+	cc0::jobs_internal::search_tree<join_node,const job*> t(cc0::jobs_internal::scratch_arena::current());
+	insert_and_increment(t, l);
+	remove_and_decrement(t, r);
+	results res;
+	struct accum
+	{
+		results *r;
+		accum(results *res) : r(res) {}
+		void operator()(join_node &n) {
+			if (n.count == 1) {
+				r->add_result(*n.value);
+			}
+		}
+	} fn(&res);
+	t.traverse(fn);
+	return res;
+}
+
+cc0::job::query::results cc0::job::query::results::join_xor(cc0::job::query::results &a, cc0::job::query::results &b)
+{
+	cc0::jobs_internal::search_tree<join_node,const job*> t(cc0::jobs_internal::scratch_arena::current());
+	insert_and_increment(t, a);
+	insert_and_increment(t, b);
+	results res;
+	struct accum
+	{
+		results *r;
+		accum(results *res) : r(res) {}
+		void operator()(join_node &n) {
+			if (n.count == 1) {
+				r->add_result(*n.value);
+			}
+		}
+	} fn(&res);
+	t.traverse(fn);
+	return res;
+}
+
+//
+// query
+//
+
+cc0::job::query::~query( void )
+{}
+
+bool cc0::job::query::operator()(const cc0::job &j) const
+{
+	return true;
+}
+
+//
+// job
+//
+
+struct cc0::job::extension : public cc0::jobs_internal::pooled
+{
+	const char      *awaited_event;   // The event that the job sleeps until it receives. Null if the job is not waiting for an event.
+	uint64_t         awaited_sender;  // The ID of the job the awaited event must originate from. Zero if the event may originate from any job.
+	uint64_t         wait_ns;         // The amount of time, in nanoseconds, left before the job stops waiting for the awaited event. Kept apart from sleep so that the job still handles other events while waiting.
+	uint64_t         deadline_ns;     // The time, local to the parent, by which the job should have ticked.
+	uint64_t         child_budget_ns; // The amount of real time children are allowed to tick for each cycle before the remaining children are deferred. Zero is unlimited.
+	dependency      *dependencies;    // The siblings that the job must tick after.
+	uint64_t         pinned_lane;     // The lane the job must be cycled on when its parent ticks children in parallel. UINT64_MAX if the job may move between lanes.
+	state_region    *state;           // The user data saved before a speculative tick.
+	uint8_t         *undo;            // The state of the job saved before a speculative tick.
+	uint64_t         undo_size;       // The capacity of the saved state in bytes.
+	job::history    *history;         // The recorded states of the job and its sub-tree. Null if no history is recorded.
+	job::history    *recorder;        // The history of the job itself, or of the closest ancestor that records one. Null if none does.
+	uint8_t         *recorded;        // The state of the job at the end of the most recently recorded cycle.
+	uint64_t         recorded_size;   // The capacity of the recorded state in bytes.
+	stats_publisher *publisher;       // Publishes statistics about the job and its sub-tree. Null if no statistics are published.
+	control_socket  *control;         // Receives commands changing the settings of the job and its sub-tree at run time. Null if no socket is open.
+	cpu_quota       *quota;           // Limits the processor time the job and its sub-tree may use. Null if unlimited.
+
+	extension( void ) :
+		awaited_event(nullptr), awaited_sender(0), wait_ns(0),
+		deadline_ns(UINT64_MAX), child_budget_ns(0),
+		dependencies(nullptr), pinned_lane(UINT64_MAX),
+		state(nullptr), undo(nullptr), undo_size(0),
+		history(nullptr), recorder(nullptr), recorded(nullptr), recorded_size(0),
+		publisher(nullptr), control(nullptr), quota(nullptr)
+	{}
+};
+
+cc0::jobs_internal::search_tree<cc0::jobs_internal::instance_fn> cc0::job::m_products = cc0::jobs_internal::search_tree<cc0::jobs_internal::instance_fn>();
+
+void cc0::job::set_deleted( void )
+{
+	CC0_JOBS_ATOMIC_STORE(m_shared->deleted, true);
+}
+
+cc0::job::extension &cc0::job::extend( void )
+{
+	if (m_extension == nullptr) {
+		m_extension = new extension;
+	}
+	return *m_extension;
+}
+
+void cc0::job::add_sibling(cc0::job *&loc, cc0::job *p)
+{
+	cc0::job *old_loc = loc;
+	loc = p;
+	loc->m_parent = this;
 	loc->m_sibling = old_loc;
+	history *own = loc->m_extension != nullptr ? loc->m_extension->history : nullptr;
+	history *recorder = own != nullptr ? own : find_history();
+	if (recorder != loc->find_history()) {
+		loc->extend().recorder = recorder;
+	}
+}
+
+void cc0::job::delete_siblings(cc0::job *&siblings)
+{
+	if (siblings != nullptr) {
+		delete_siblings(siblings->m_sibling);
+		delete siblings;
+		siblings = nullptr;
+	}
+}
+
+void cc0::job::delete_children(cc0::job *&children)
+{
+	if (children != nullptr) {
+		delete_siblings(children->m_sibling);
+		delete children;
+		children = nullptr;
+	}
+}
+
+void cc0::job::delete_killed_children(cc0::job *&child)
+{
+	if (child != nullptr) {
+		delete_killed_children(child->m_sibling);
+		if (child->is_killed()) {
+			job *sibling = child->m_sibling; // Save the next child in the list.
+			child->m_sibling = nullptr;      // Set this to null to prevent recursive deletion of all subsequent siblings.
+			if (!child->record_burial(sibling)) {
+				delete child;                // Delete the current child only.
+			}
+			child = sibling;                 // Refer the current child node to the next child in the child list. This also repairs the linked list since the child pointer is a reference.
+			mark_bloom_dirty();
+		}
+	}
+}
+
+void cc0::job::detach_components( void )
+{
+	struct detacher
+	{
+		void operator()(component_slot &s) {
+			s.detach(s.index);
+		}
+	} fn;
+	cc0::jobs_internal::component_lock lock;
+	m_components.traverse(fn);
+}
+
+void cc0::job::prefetch(const cc0::job *j)
+{
+	if (j != nullptr) {
+		const char *p = reinterpret_cast<const char*>(j);
+		for (uint64_t i = 0; i < sizeof(cc0::job); i += CACHE_LINE) {
+			PREFETCH(p + i);
+		}
+	}
+}
+
+bool cc0::job::precedes(const cc0::job *a, const cc0::job *b, cc0::job::schedule_mode mode)
+{
+	if (a->m_dependency_level != b->m_dependency_level) {
+		return a->m_dependency_level < b->m_dependency_level;
+	}
+	// Children deferred by the child budget age, so that they are not starved by the children scheduled before them.
+	switch (mode) {
+	case SCHEDULE_BY_PRIORITY: {
+		const int64_t pa = a->m_priority < INT64_MAX - int64_t(a->m_deferrals) ? a->m_priority + int64_t(a->m_deferrals) : INT64_MAX;
+		const int64_t pb = b->m_priority < INT64_MAX - int64_t(b->m_deferrals) ? b->m_priority + int64_t(b->m_deferrals) : INT64_MAX;
+		return pa > pb;
+	}
+	case SCHEDULE_BY_DEADLINE: return a->m_deferrals != b->m_deferrals ? a->m_deferrals > b->m_deferrals : a->get_deadline_ns() < b->get_deadline_ns();
+	default: break;
+	}
+	return a->m_deferrals > b->m_deferrals;
+}
+
+cc0::job *cc0::job::sort_siblings(cc0::job *list, cc0::job::schedule_mode mode)
+{
+	if (list == nullptr || list->m_sibling == nullptr) {
+		return list;
+	}
+	cc0::job *middle = list;
+	for (cc0::job *fast = list->m_sibling; fast != nullptr && fast->m_sibling != nullptr; fast = fast->m_sibling->m_sibling) {
+		middle = middle->m_sibling;
+	}
+	cc0::job *a = list;
+	cc0::job *b = middle->m_sibling;
+	middle->m_sibling = nullptr;
+	a = sort_siblings(a, mode);
+	b = sort_siblings(b, mode);
+	cc0::job *head = nullptr;
+	cc0::job **tail = &head;
+	while (a != nullptr && b != nullptr) {
+		// Only take from the second half if it strictly precedes the first in order to keep the sort stable.
+		cc0::job **next = precedes(b, a, mode) ? &b : &a;
+		*tail = *next;
+		tail = &(*next)->m_sibling;
+		*next = (*next)->m_sibling;
+	}
+	*tail = a != nullptr ? a : b;
+	return head;
+}
+
+void cc0::job::mark_schedule_dirty( void )
+{
+	if (m_parent != nullptr) {
+		m_parent->m_schedule_dirty = true;
+	}
+}
+
+uint64_t cc0::job::update_dependency_level(cc0::job *child)
+{
+	static const uint64_t UNVISITED = UINT64_MAX;
+	static const uint64_t VISITING  = UINT64_MAX - 1;
+	if (child->m_dependency_level == UNVISITED) {
+		child->m_dependency_level = VISITING;
+		uint64_t level = 0;
+		for (dependency **d = child->m_extension != nullptr ? &child->m_extension->dependencies : nullptr; d != nullptr && *d != nullptr;) {
+			cc0::job *j = (*d)->target.get_job();
+			if (j == nullptr || j->m_parent != this) {
+				dependency *dead = *d;
+				*d = dead->next;
+				delete dead;
+				continue;
+			}
+			if (j->m_dependency_level != VISITING) {
+				const uint64_t l = update_dependency_level(j) + 1;
+				level = l > level ? l : level;
+			}
+			d = &(*d)->next;
+		}
+		child->m_dependency_level = level;
+	}
+	return child->m_dependency_level;
+}
+
+bool cc0::job::update_dependency_levels( void )
+{
+	bool dependencies = false;
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		c->m_dependency_level = UINT64_MAX;
+		dependencies = dependencies || (c->m_extension != nullptr && c->m_extension->dependencies != nullptr);
+	}
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		if (dependencies) {
+			update_dependency_level(c);
+		} else {
+			c->m_dependency_level = 0;
+		}
+	}
+	return dependencies;
+}
+
+bool cc0::job::needs_rebalance(uint64_t lanes) const
+{
+	uint64_t *load = cc0::job::scratch_new<uint64_t>(lanes);
+	for (uint64_t l = 0; l < lanes; ++l) {
+		load[l] = 0;
+	}
+	uint64_t total = 0;
+	for (const cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		const uint64_t pinned_lane = c->get_pinned_lane();
+		if (c->m_lane >= lanes || (pinned_lane != UINT64_MAX && c->m_lane != (pinned_lane < lanes ? pinned_lane : lanes - 1))) {
+			return true;
+		}
+		load[c->m_lane] += c->m_cost_ns;
+		total += c->m_cost_ns;
+	}
+	uint64_t max_load = 0;
+	for (uint64_t l = 0; l < lanes; ++l) {
+		max_load = load[l] > max_load ? load[l] : max_load;
+	}
+	// Hysteresis: Only move children once the busiest lane is well above average so that measurement noise does not make children bounce between threads.
+	const uint64_t average = total / lanes;
+	return max_load > average + average / 4 && max_load - average > 10000;
+}
+
+// Orders children by decreasing cost, and by creation when the costs are equal so that the order is deterministic.
+static bool costlier(const cc0::job *a, const cc0::job *b)
+{
+	return a->get_tick_cost_ns() != b->get_tick_cost_ns() ? a->get_tick_cost_ns() > b->get_tick_cost_ns() : a->get_job_id() < b->get_job_id();
+}
+
+void cc0::job::rebalance(uint64_t lanes)
+{
+	uint64_t n = 0;
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		++n;
+	}
+	cc0::job **sorted = cc0::job::scratch_new<cc0::job*>(n);
+	uint64_t *load = cc0::job::scratch_new<uint64_t>(lanes);
+	bool *reserved = cc0::job::scratch_new<bool>(lanes);
+	for (uint64_t l = 0; l < lanes; ++l) {
+		load[l] = 0;
+		reserved[l] = false;
+	}
+	uint64_t total = 0;
+	uint64_t reserved_count = 0;
+	n = 0;
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		const uint64_t pinned_lane = c->get_pinned_lane();
+		if (pinned_lane != UINT64_MAX) {
+			// Pinned children are placed first, and their lanes are kept free from other children.
+			c->m_lane = pinned_lane < lanes ? pinned_lane : lanes - 1;
+			load[c->m_lane] += c->m_cost_ns;
+			reserved_count += reserved[c->m_lane] ? 0 : 1;
+			reserved[c->m_lane] = true;
+			continue;
+		}
+		sorted[n++] = c;
+		total += c->m_cost_ns;
+	}
+	std::sort(sorted, sorted + n, costlier);
+	const bool exclusive = reserved_count < lanes;
+	const uint64_t slack = total / lanes / 8;
+	for (uint64_t i = 0; i < n; ++i) {
+		// Place the most expensive children first, each on the least loaded lane, but keep a child on its current lane if that lane is nearly as good, so that its data stays in that core's cache.
+		cc0::job *c = sorted[i];
+		uint64_t best = UINT64_MAX;
+		for (uint64_t l = 0; l < lanes; ++l) {
+			if (!(exclusive && reserved[l]) && (best == UINT64_MAX || load[l] < load[best])) {
+				best = l;
+			}
+		}
+		if (c->m_lane < lanes && !(exclusive && reserved[c->m_lane]) && load[c->m_lane] <= load[best] + slack) {
+			best = c->m_lane;
+		}
+		c->m_lane = best;
+		load[best] += c->m_cost_ns;
+	}
+}
+
+thread_local cc0::job *cc0::jobs_internal::speculation_root = nullptr;
+
+struct speculation_record
+{
+	uint64_t first_event; // The index of the first event the child queued.
+	uint64_t last_event;  // One past the index of the last event the child queued.
+	uint64_t changes;     // The number of jobs added or killed by the child.
+	bool     conflict;    // Indicates that the child accessed a job outside of its sub-tree.
+	bool     serial;      // Indicates that the child was not ticked, since its sub-tree contains data that is not registered.
+};
+
+static thread_local speculation_record g_speculation;
+
+struct job_state
+{
+	uint64_t    sleep_ns;
+	const char *awaited_event;
+	uint64_t    awaited_sender;
+	uint64_t    wait_ns;
+	uint64_t    existed_for_ns;
+	uint64_t    active_for_ns;
+	uint64_t    existed_tick_count;
+	uint64_t    active_tick_count;
+	uint64_t    time_scale;
+	uint64_t    accumulated_duration_ns;
+	int64_t     priority;
+	uint64_t    deadline_ns;
+	uint64_t    user_size;   // The size of the registered user data that follows.
+	bool        enabled;
+	bool        waiting;
+	bool        killed;
+	bool        completed;
+	bool        paused;
+	bool        frozen;
+};
+
+bool cc0::job::track_access(const cc0::job *target)
+{
+	for (const cc0::job *j = target; j != nullptr; j = j->m_parent) {
+		if (j == cc0::jobs_internal::speculation_root) {
+			return true;
+		}
+	}
+	g_speculation.conflict = true;
+	return false;
+}
+
+bool cc0::job::track_change(const cc0::job *target)
+{
+	if (track_access(target)) {
+		++g_speculation.changes;
+		return true;
+	}
+	return false;
+}
+
+uint64_t cc0::job::get_state_size( void ) const
+{
+	uint64_t size = sizeof(job_state);
+	for (const state_region *r = m_extension != nullptr ? m_extension->state : nullptr; r != nullptr; r = r->next) {
+		size += r->size;
+	}
+	return size;
+}
+
+void cc0::job::save_state(uint8_t *state) const
+{
+	job_state s;
+	std::memset(&s, 0, sizeof(job_state)); // Padding is cleared so that saved states can be compared byte by byte.
+	s.sleep_ns                = m_sleep_ns;
+	s.awaited_event           = m_extension != nullptr ? m_extension->awaited_event : nullptr;
+	s.awaited_sender          = m_extension != nullptr ? m_extension->awaited_sender : 0;
+	s.wait_ns                 = m_extension != nullptr ? m_extension->wait_ns : 0;
+	s.existed_for_ns          = m_existed_for_ns;
+	s.active_for_ns           = m_active_for_ns;
+	s.existed_tick_count      = m_existed_tick_count;
+	s.active_tick_count       = m_active_tick_count;
+	s.time_scale              = m_time_scale;
+	s.accumulated_duration_ns = m_accumulated_duration_ns;
+	s.priority                = m_priority;
+	s.deadline_ns             = get_deadline_ns();
+	s.user_size               = get_state_size() - sizeof(job_state);
+	s.enabled                 = m_enabled;
+	s.waiting                 = m_waiting;
+	s.killed                  = m_kill;
+	s.completed               = m_shared->completed;
+	s.paused                  = m_paused;
+	s.frozen                  = m_frozen;
+	std::memcpy(state, &s, sizeof(job_state));
+	state += sizeof(job_state);
+	for (const state_region *r = m_extension != nullptr ? m_extension->state : nullptr; r != nullptr; r = r->next) {
+		std::memcpy(state, r->data, r->size);
+		state += r->size;
+	}
+}
+
+void cc0::job::restore_state(const uint8_t *state)
+{
+	job_state s;
+	std::memcpy(&s, state, sizeof(job_state));
+	m_sleep_ns                = s.sleep_ns;
+	m_existed_for_ns          = s.existed_for_ns;
+	m_active_for_ns           = s.active_for_ns;
+	m_existed_tick_count      = s.existed_tick_count;
+	m_active_tick_count       = s.active_tick_count;
+	m_time_scale              = s.time_scale;
+	m_accumulated_duration_ns = s.accumulated_duration_ns;
+	m_priority                = s.priority;
+	m_enabled                 = s.enabled;
+	m_waiting                 = s.waiting;
+	m_kill                    = s.killed;
+	m_shared->completed       = s.completed;
+	m_paused                  = s.paused;
+	m_frozen                  = s.frozen;
+	if (m_extension != nullptr || s.awaited_event != nullptr || s.deadline_ns != UINT64_MAX) {
+		extension &e = extend();
+		e.awaited_event  = s.awaited_event;
+		e.awaited_sender = s.awaited_sender;
+		e.wait_ns        = s.wait_ns;
+		e.deadline_ns    = s.deadline_ns;
+	}
+	// Regions registered after the state was saved are left as they are. They are appended, so the saved regions come first.
+	state += sizeof(job_state);
+	uint64_t restored = 0;
+	for (state_region *r = m_extension != nullptr ? m_extension->state : nullptr; r != nullptr && restored + r->size <= s.user_size; r = r->next) {
+		std::memcpy(r->data, state + restored, r->size);
+		restored += r->size;
+	}
+}
+
+uint64_t cc0::job::get_saved_state_size(const uint8_t *state)
+{
+	job_state s;
+	std::memcpy(&s, state, sizeof(job_state));
+	return sizeof(job_state) + s.user_size;
+}
+
+void cc0::job::update_state_registered( void )
+{
+	// The data of the derived classes follows cc0::job, after padding up to the alignment of the first member. Registered regions must cover the rest without gaps, except for the padding at the end of the class.
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(this);
+	const uintptr_t end = begin + m_object_size;
+	uintptr_t covered = begin + ((sizeof(cc0::job) + m_object_align - 1) & ~(m_object_align - 1));
+	for (bool extended = true; covered < end && extended;) {
+		extended = false;
+		for (const state_region *r = m_extension != nullptr ? m_extension->state : nullptr; r != nullptr; r = r->next) {
+			const uintptr_t data = reinterpret_cast<uintptr_t>(r->data);
+			if (data <= covered && data + r->size > covered) {
+				covered = data + r->size;
+				extended = true;
+			}
+		}
+	}
+	m_state_registered = covered + m_object_align > end;
+}
+
+bool cc0::job::save_subtree( void )
+{
+	const uint64_t size = get_state_size();
+	extension &e = extend();
+	if (size > e.undo_size) {
+		cc0::jobs_internal::deallocate(e.undo, e.undo_size);
+		e.undo = reinterpret_cast<uint8_t*>(cc0::jobs_internal::allocate(size));
+		e.undo_size = size;
+	}
+	save_state(e.undo);
+	bool registered = m_state_registered;
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		registered = c->save_subtree() && registered;
+	}
+	return registered;
+}
+
+void cc0::job::undo_subtree( void )
+{
+	for (cc0::job **c = &m_child; *c != nullptr;) {
+		if ((*c)->m_speculative) {
+			cc0::job *added = *c;
+			*c = added->m_sibling;
+			added->m_sibling = nullptr;
+			delete added;
+		} else {
+			(*c)->undo_subtree();
+			c = &(*c)->m_sibling;
+		}
+	}
+	m_kill_pending = false;
+	restore_state(m_extension->undo); // Saved before the speculative tick.
+}
+
+void cc0::job::commit_subtree( void )
+{
+	if (m_speculative) {
+		m_speculative = false;
+		record_spawn();
+	}
+	if (m_kill_pending) {
+		m_kill_pending = false;
+		kill();
+	}
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		c->commit_subtree();
+	}
+}
+
+struct history_op
+{
+	cc0::job *job;   // The job that was added or removed.
+	cc0::job *next;  // The sibling that followed the removed job.
+	bool      spawn; // Indicates that the job was added rather than removed.
+};
+
+struct history_frame
+{
+	uint64_t   *log;          // The states of the jobs that changed during the cycle, as they were before the cycle. Each entry is the job, the size of the state, and the state.
+	uint64_t    log_size;     // The size of the log in 64-bit words.
+	uint64_t    log_capacity;
+	history_op *ops;          // The jobs added and removed during the cycle, in order.
+	uint64_t    op_count;
+	uint64_t    op_capacity;
+
+	history_frame( void ) : log(nullptr), log_size(0), log_capacity(0), ops(nullptr), op_count(0), op_capacity(0) {}
+
+	~history_frame( void )
+	{
+		cc0::jobs_internal::deallocate(log, log_capacity * sizeof(uint64_t));
+		cc0::jobs_internal::deallocate(ops, op_capacity * sizeof(history_op));
+	}
+
+	uint64_t *add_entry(uint64_t words)
+	{
+		if (log_size + words > log_capacity) {
+			uint64_t new_capacity = log_capacity > 0 ? log_capacity * 2 : 1024;
+			while (new_capacity < log_size + words) {
+				new_capacity *= 2;
+			}
+			uint64_t *new_log = reinterpret_cast<uint64_t*>(cc0::jobs_internal::allocate(new_capacity * sizeof(uint64_t)));
+			if (log != nullptr) {
+				std::memcpy(new_log, log, log_size * sizeof(uint64_t));
+			}
+			cc0::jobs_internal::deallocate(log, log_capacity * sizeof(uint64_t));
+			log = new_log;
+			log_capacity = new_capacity;
+		}
+		uint64_t *entry = log + log_size;
+		log_size += words;
+		return entry;
+	}
+
+	void add_op(cc0::job *job, cc0::job *next, bool spawn)
+	{
+		if (op_count == op_capacity) {
+			const uint64_t new_capacity = op_capacity > 0 ? op_capacity * 2 : 64;
+			history_op *new_ops = reinterpret_cast<history_op*>(cc0::jobs_internal::allocate(new_capacity * sizeof(history_op)));
+			for (uint64_t i = 0; i < op_count; ++i) {
+				new_ops[i] = ops[i];
+			}
+			cc0::jobs_internal::deallocate(ops, op_capacity * sizeof(history_op));
+			ops = new_ops;
+			op_capacity = new_capacity;
+		}
+		ops[op_count].job = job;
+		ops[op_count].next = next;
+		ops[op_count].spawn = spawn;
+		++op_count;
+	}
+
+	void clear( void )
+	{
+		log_size = 0;
+		op_count = 0;
+	}
+};
+
+#define FULL_STATE (1ULL << 63ULL)
+
+struct cc0::job::history
+{
+	history_frame *frames;       // A ring of closed frames, followed by the open frame that records the current cycle.
+	uint64_t       capacity;     // The maximum number of closed frames.
+	uint64_t       first;        // The index of the oldest closed frame.
+	uint64_t       count;        // The number of closed frames.
+	std::mutex     mutex;        // Protects the open frame from jobs added and removed on worker threads.
+	uint64_t      *scratch;      // Holds the current state of a job while comparing it to its recorded state.
+	uint64_t       scratch_size; // The capacity of the scratch space in 64-bit words.
+
+	explicit history(uint64_t cycles) : frames(new history_frame[cycles + 1]), capacity(cycles), first(0), count(0), scratch(nullptr), scratch_size(0) {}
+
+	~history( void )
+	{
+		for (uint64_t i = 0; i <= capacity; ++i) {
+			bury(frames[i]);
+		}
+		delete [] frames;
+		cc0::jobs_internal::deallocate(scratch, scratch_size * sizeof(uint64_t));
+	}
+
+	history_frame &open_frame( void )
+	{
+		return frames[(first + count) % (capacity + 1)];
+	}
+
+	static uint64_t words(uint64_t bytes)
+	{
+		return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	}
+
+	static void set_recorded(cc0::job &j, const uint8_t *state, uint64_t size)
+	{
+		extension &e = j.extend();
+		if (size > e.recorded_size) {
+			cc0::jobs_internal::deallocate(e.recorded, e.recorded_size);
+			e.recorded_size = words(size) * sizeof(uint64_t);
+			e.recorded = reinterpret_cast<uint8_t*>(cc0::jobs_internal::allocate(e.recorded_size));
+		}
+		reinterpret_cast<uint64_t*>(e.recorded)[words(size) - 1] = 0; // The padding is cleared so that states can be compared word by word.
+		std::memcpy(e.recorded, state, size);
+	}
+
+	void reset(cc0::job &j)
+	{
+		if (j.m_extension != nullptr) {
+			cc0::jobs_internal::deallocate(j.m_extension->recorded, j.m_extension->recorded_size);
+			j.m_extension->recorded = nullptr;
+			j.m_extension->recorded_size = 0;
+		}
+		for (cc0::job *c = j.m_child; c != nullptr; c = c->m_sibling) {
+			reset(*c);
+		}
+	}
+
+	void record(cc0::job &j, history_frame &f)
+	{
+		const uint64_t size = j.get_state_size();
+		const uint64_t n = words(size);
+		if (n > scratch_size) {
+			cc0::jobs_internal::deallocate(scratch, scratch_size * sizeof(uint64_t));
+			scratch_size = n;
+			scratch = reinterpret_cast<uint64_t*>(cc0::jobs_internal::allocate(scratch_size * sizeof(uint64_t)));
+		}
+		scratch[n - 1] = 0;
+		j.save_state(reinterpret_cast<uint8_t*>(scratch));
+		extension &e = j.extend(); // Recorded jobs have a recorder, and so already have the extension.
+		if (e.recorded == nullptr) {
+			set_recorded(j, reinterpret_cast<const uint8_t*>(scratch), size); // Jobs added during the cycle have nothing to restore. They are deleted instead.
+		} else {
+			const uint64_t recorded_size = get_saved_state_size(e.recorded);
+			if (recorded_size != size) {
+				// The registered user data changed size, so the whole state is logged.
+				uint64_t *entry = f.add_entry(2 + words(recorded_size));
+				entry[0] = reinterpret_cast<uint64_t>(&j);
+				entry[1] = recorded_size | FULL_STATE;
+				std::memcpy(entry + 2, e.recorded, recorded_size);
+				set_recorded(j, reinterpret_cast<const uint8_t*>(scratch), size);
+			} else {
+				// Only the words that changed are logged, following a mask of which words they are.
+				const uint64_t masks = (n + 63) / 64;
+				const uint64_t start = f.log_size;
+				uint64_t *entry = f.add_entry(2 + masks + n);
+				uint64_t *mask = entry + 2;
+				uint64_t *values = mask + masks;
+				uint64_t *recorded = reinterpret_cast<uint64_t*>(e.recorded);
+				uint64_t changed = 0;
+				for (uint64_t m = 0; m < masks; ++m) {
+					mask[m] = 0;
+				}
+				for (uint64_t w = 0; w < n; ++w) {
+					if (recorded[w] != scratch[w]) {
+						mask[w / 64] |= 1ULL << (w % 64);
+						values[changed++] = recorded[w];
+						recorded[w] = scratch[w];
+					}
+				}
+				if (changed > 0) {
+					entry[0] = reinterpret_cast<uint64_t>(&j);
+					entry[1] = size;
+					f.log_size = start + 2 + masks + changed;
+				} else {
+					f.log_size = start;
+				}
+			}
+		}
+		// Siblings are fetched ahead, like when ticking, since recording otherwise waits on a cache miss per job.
+		if (j.m_child != nullptr) {
+			prefetch(j.m_child->m_sibling);
+		}
+		for (cc0::job *c = j.m_child; c != nullptr; c = c->m_sibling) {
+			const cc0::job *n = c->m_sibling;
+			if (n != nullptr) {
+				prefetch(n->m_sibling);
+				PREFETCH(n->m_extension);
+			}
+			record(*c, f);
+		}
+	}
+
+	void close(cc0::job &owner)
+	{
+		history_frame &f = open_frame();
+		record(owner, f);
+		for (uint64_t i = 0; i < f.op_count; ++i) {
+			if (!f.ops[i].spawn) {
+				record(*f.ops[i].job, f); // Jobs killed during the cycle are no longer part of the tree.
+			}
+		}
+		if (count == capacity) {
+			bury(frames[first]);
+			frames[first].clear();
+			first = (first + 1) % (capacity + 1);
+			--count;
+		}
+		++count;
+		open_frame().clear();
+	}
+
+	static void bury(history_frame &f)
+	{
+		// The jobs killed during the frame can no longer be revived.
+		for (uint64_t i = 0; i < f.op_count; ++i) {
+			if (!f.ops[i].spawn) {
+				f.ops[i].job->m_sibling = nullptr;
+				delete f.ops[i].job;
+			}
+		}
+		f.op_count = 0;
+	}
+
+	static void undo(history_frame &f)
+	{
+		for (uint64_t i = f.op_count; i > 0; --i) {
+			const history_op &op = f.ops[i - 1];
+			cc0::job *parent = op.job->m_parent;
+			cc0::job **loc = &parent->m_child;
+			if (op.spawn) {
+				while (*loc != op.job) {
+					loc = &(*loc)->m_sibling;
+				}
+				*loc = op.job->m_sibling;
+				op.job->m_sibling = nullptr;
+				delete op.job;
+				parent->mark_bloom_dirty();
+			} else {
+				// Every later change has been undone, so the sibling that followed the job is back in place.
+				while (*loc != op.next) {
+					loc = &(*loc)->m_sibling;
+				}
+				op.job->m_sibling = *loc;
+				*loc = op.job;
+				parent->add_subtree_bloom(op.job->m_subtree_bloom);
+			}
+			parent->m_schedule_dirty = true;
+		}
+		for (uint64_t i = 0; i < f.log_size;) {
+			cc0::job *j = reinterpret_cast<cc0::job*>(f.log[i]);
+			const uint64_t size = f.log[i + 1] & ~FULL_STATE;
+			if ((f.log[i + 1] & FULL_STATE) != 0) {
+				set_recorded(*j, reinterpret_cast<const uint8_t*>(f.log + i + 2), size);
+				i += 2 + words(size);
+			} else {
+				// The recorded state is the state after the frame, since later frames have already been undone.
+				const uint64_t masks = (words(size) + 63) / 64;
+				const uint64_t *mask = f.log + i + 2;
+				const uint64_t *values = mask + masks;
+				uint64_t *recorded = reinterpret_cast<uint64_t*>(j->m_extension->recorded);
+				uint64_t changed = 0;
+				for (uint64_t w = 0; w < words(size); ++w) {
+					if ((mask[w / 64] & (1ULL << (w % 64))) != 0) {
+						recorded[w] = values[changed++];
+					}
+				}
+				i += 2 + masks + changed;
+			}
+			j->restore_state(j->m_extension->recorded);
+		}
+		f.clear();
+	}
+};
+
+cc0::job::history *cc0::job::find_history( void )
+{
+	return m_extension != nullptr ? m_extension->recorder : nullptr;
+}
+
+void cc0::job::set_recorder(cc0::job::history *inherited)
+{
+	history *own = m_extension != nullptr ? m_extension->history : nullptr;
+	history *recorder = own != nullptr ? own : inherited;
+	if (recorder != find_history()) {
+		extend().recorder = recorder;
+	}
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		c->set_recorder(recorder);
+	}
+}
+
+void cc0::job::record_spawn( void )
+{
+	history *h = m_parent != nullptr ? m_parent->find_history() : nullptr;
+	if (h != nullptr) {
+		std::lock_guard<std::mutex> lock(h->mutex);
+		h->open_frame().add_op(this, nullptr, true);
+	}
+}
+
+bool cc0::job::record_burial(cc0::job *next)
+{
+	history *h = m_parent != nullptr ? m_parent->find_history() : nullptr;
+	if (h != nullptr) {
+		std::lock_guard<std::mutex> lock(h->mutex);
+		h->open_frame().add_op(this, next, false);
+		return true;
+	}
+	return false;
+}
+
+void cc0::job::set_history_length(uint64_t cycles)
+{
+	if (cycles == 0 && m_extension == nullptr) {
+		return;
+	}
+	extension &e = extend();
+	if (e.history != nullptr) {
+		delete e.history;
+		e.history = nullptr;
+	}
+	if (cycles > 0) {
+		e.history = new history(cycles);
+	}
+	set_recorder(m_parent != nullptr ? m_parent->find_history() : nullptr);
+	if (e.history != nullptr) {
+		e.history->reset(*this);
+		e.history->record(*this, e.history->open_frame()); // Records the initial state. Nothing is logged, since no job has been recorded before.
+	}
+}
+
+uint64_t cc0::job::get_history_length( void ) const
+{
+	return m_extension != nullptr && m_extension->history != nullptr ? m_extension->history->capacity : 0;
+}
+
+uint64_t cc0::job::rewind(uint64_t cycles)
+{
+	if (m_extension == nullptr || m_extension->history == nullptr) {
+		return 0;
+	}
+	history &h = *m_extension->history;
+	history_frame &open = h.open_frame();
+	h.record(*this, open); // Changes made since the last cycle are undone along with the cycles.
+	for (uint64_t i = 0; i < open.op_count; ++i) {
+		if (!open.ops[i].spawn) {
+			h.record(*open.ops[i].job, open);
+		}
+	}
+	h.undo(open);
+	uint64_t n = 0;
+	for (; n < cycles && h.count > 0; ++n) {
+		--h.count;
+		h.undo(h.open_frame());
+	}
+	return n;
+}
+
+#define STATS_MAGIC   0x63633073746174ULL // Identifies a shared memory object holding statistics.
+#define STATS_SAMPLES 128ULL              // The number of recent cycle times that percentiles are computed over.
+#define STATS_RETRIES 1000ULL             // The number of attempts at reading a consistent copy of the statistics before giving up.
+
+struct stats_region
+{
+	uint64_t        magic;    // STATS_MAGIC once the object has been initialized.
+	uint64_t        sequence; // Odd while the statistics are being written.
+	cc0::job::stats data;
+};
+
+struct cc0::job::stats_publisher
+{
+	char            *name;                   // The name of the shared memory object.
+	stats_region    *region;                 // The mapped shared memory object.
+	uint64_t         interval;               // The number of cycles between publications.
+	uint64_t         cycles;                 // The number of cycles since the last publication.
+	uint64_t         samples[STATS_SAMPLES]; // The most recent cycle times.
+	uint64_t         sample_count;           // The number of cycle times measured.
+	cc0::job::stats  data;                   // The statistics being collected.
+
+	stats_publisher( void ) : name(nullptr), region(nullptr), interval(1), cycles(0), sample_count(0) {}
+
+	~stats_publisher( void )
+	{
+#if defined(__linux__)
+		if (region != nullptr) {
+			munmap(region, sizeof(stats_region));
+			shm_unlink(name);
+		}
+#endif
+		delete [] name;
+	}
+
+	void count(const cc0::job &j)
+	{
+		++data.job_count;
+		data.active_count   += j.is_active() ? 1 : 0;
+		data.sleeping_count += j.is_sleeping() ? 1 : 0;
+		data.waiting_count  += j.is_waiting_for_event() ? 1 : 0;
+		data.killed_count   += j.is_killed() ? 1 : 0;
+		const char *type = j.object_name();
+		uint64_t t = 0;
+		while (t < data.type_count && std::strncmp(data.types[t].name, type, sizeof(data.types[t].name) - 1) != 0) {
+			++t;
+		}
+		if (t == data.type_count && t < cc0::job::stats::MAX_TYPES) {
+			std::strncpy(data.types[t].name, type, sizeof(data.types[t].name) - 1);
+			++data.type_count;
+		}
+		if (t < data.type_count) {
+			++data.types[t].count;
+		}
+		for (const cc0::job *c = j.m_child; c != nullptr; c = c->m_sibling) {
+			count(*c);
+		}
+	}
+
+	static uint64_t percentile(const uint64_t *sorted, uint64_t n, uint64_t p)
+	{
+		return n > 0 ? sorted[(n - 1) * p / 100] : 0;
+	}
+
+	void publish(const cc0::job &owner, uint64_t cycle_ns)
+	{
+		samples[sample_count++ % STATS_SAMPLES] = cycle_ns;
+		if (++cycles < interval) {
+			return;
+		}
+		cycles = 0;
+		const uint64_t cycle = data.cycle + 1;
+		std::memset(&data, 0, sizeof(data)); // Also terminates the names of the classes.
+		data.cycle = cycle;
+		count(owner);
+		data.queue_depth = g_delivered_events;
+		uint64_t sorted[STATS_SAMPLES];
+		const uint64_t n = sample_count < STATS_SAMPLES ? sample_count : STATS_SAMPLES;
+		std::memcpy(sorted, samples, n * sizeof(uint64_t));
+		std::sort(sorted, sorted + n);
+		data.cycle_ns_p50 = percentile(sorted, n, 50);
+		data.cycle_ns_p90 = percentile(sorted, n, 90);
+		data.cycle_ns_p99 = percentile(sorted, n, 99);
+		data.cycle_ns_max = n > 0 ? sorted[n - 1] : 0;
+#if defined(__linux__)
+		// Seqlock: Readers retry if the sequence is odd, or changed while they copied the statistics, so the ticking thread never waits for a reader.
+		const uint64_t sequence = region->sequence;
+		__atomic_store_n(&region->sequence, sequence + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		std::memcpy(&region->data, &data, sizeof(data));
+		__atomic_store_n(&region->sequence, sequence + 2, __ATOMIC_RELEASE);
+#endif
+	}
+};
+
+bool cc0::job::publish_stats(const char *name, uint64_t interval_cycles)
+{
+	if (m_extension != nullptr) {
+		delete m_extension->publisher;
+		m_extension->publisher = nullptr;
+	}
+#if defined(__linux__)
+	if (name == nullptr) {
+		return true;
+	}
+	const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	void *region = ftruncate(fd, sizeof(stats_region)) == 0 ? mmap(nullptr, sizeof(stats_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd); // The mapping keeps the object open.
+	if (region == MAP_FAILED) {
+		shm_unlink(name);
+		return false;
+	}
+	stats_publisher *publisher = new stats_publisher;
+	publisher->name = new char[std::strlen(name) + 1];
+	std::strcpy(publisher->name, name);
+	publisher->region = reinterpret_cast<stats_region*>(region);
+	publisher->interval = interval_cycles > 0 ? interval_cycles : 1;
+	std::memset(&publisher->data, 0, sizeof(publisher->data));
+	publisher->region->sequence = 0;
+	__atomic_store_n(&publisher->region->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+	extend().publisher = publisher;
+	return true;
+#else
+	return name == nullptr;
+#endif
 }
 
-void cc0::job::delete_siblings(cc0::job *&siblings)
+bool cc0::job::read_stats(const char *name, cc0::job::stats &out)
 {
-	if (siblings != nullptr) {
-		delete_siblings(siblings->m_sibling);
-		delete siblings;
-		siblings = nullptr;
+#if defined(__linux__)
+	const int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+	void *mapping = mmap(nullptr, sizeof(stats_region), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	const stats_region *region = reinterpret_cast<const stats_region*>(mapping);
+	bool consistent = false;
+	if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) == STATS_MAGIC) {
+		// The publisher may have died in the middle of a write, so the number of attempts is bounded.
+		for (uint64_t attempt = 0; attempt < STATS_RETRIES && !consistent; ++attempt) {
+			const uint64_t before = __atomic_load_n(&region->sequence, __ATOMIC_ACQUIRE);
+			if ((before & 1) == 0) {
+				std::memcpy(&out, &region->data, sizeof(out));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				consistent = __atomic_load_n(&region->sequence, __ATOMIC_RELAXED) == before;
+			}
+			if (!consistent) {
+				std::this_thread::yield();
+			}
+		}
 	}
+	munmap(mapping, sizeof(stats_region));
+	return consistent;
+#else
+	return false;
+#endif
 }
 
-void cc0::job::delete_children(cc0::job *&children)
+#define CONTROL_MAX_CLIENTS 8ULL   // The maximum number of operators connected at once.
+#define CONTROL_LINE_SIZE   256ULL // The maximum length of a command.
+#define CONTROL_MAX_READS   4ULL   // The maximum number of reads from one operator per poll, so that a flooding operator can not stall the ticking thread.
+
+struct control_client
 {
-	if (children != nullptr) {
-		delete_siblings(children->m_sibling);
-		delete children;
-		children = nullptr;
+	int      fd;                      // The connection. Negative if the slot is free.
+	char     line[CONTROL_LINE_SIZE]; // The command received so far.
+	uint64_t length;                  // The number of characters received so far.
+	bool     overflow;                // Indicates that the command is too long, and is discarded up to the next newline.
+};
+
+struct cc0::job::control_socket
+{
+	char           *path;                         // The path of the socket.
+	int             fd;                           // The listening socket.
+	control_client  clients[CONTROL_MAX_CLIENTS]; // The connected operators.
+
+	control_socket( void ) : path(nullptr), fd(-1)
+	{
+		for (uint64_t i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+			clients[i].fd = -1;
+			clients[i].length = 0;
+			clients[i].overflow = false;
+		}
+	}
+
+	~control_socket( void )
+	{
+#if defined(__linux__)
+		for (uint64_t i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+			if (clients[i].fd >= 0) {
+				::close(clients[i].fd);
+			}
+		}
+		if (fd >= 0) {
+			::close(fd);
+			::unlink(path);
+		}
+#endif
+		delete [] path;
+	}
+
+	static uint64_t select(cc0::job &j, const char *selector, void (*fn)(cc0::job&, void*), void *context)
+	{
+		// Jobs are selected by ID with a leading '#', by class name, or all of them with '*'.
+		uint64_t count = 0;
+		if (selector[0] == '*' || (selector[0] == '#' ? std::strtoull(selector + 1, nullptr, 10) == j.get_job_id() : std::strcmp(selector, j.object_name()) == 0)) {
+			fn(j, context);
+			++count;
+		}
+		for (cc0::job *c = j.m_child; c != nullptr; c = c->m_sibling) {
+			count += select(*c, selector, fn, context);
+		}
+		return count;
+	}
+
+	static void set_tick_rate(cc0::job &j, void *context)
+	{
+		const uint64_t *rate = reinterpret_cast<const uint64_t*>(context);
+		if (rate[0] == 0 && rate[1] == 0) {
+			j.unlimit_tick_rate();
+		} else {
+			j.limit_tick_rate(rate[0], rate[1]);
+		}
+	}
+
+	static void set_time_scale(cc0::job &j, void *context)
+	{
+		j.set_local_time_scale(*reinterpret_cast<const float*>(context));
+	}
+
+	static void set_max_ticks(cc0::job &j, void *context)
+	{
+		j.set_max_tick_per_cycle(*reinterpret_cast<const uint64_t*>(context));
+	}
+
+	static void set_cpu_quota(cc0::job &j, void *context)
+	{
+		const uint64_t *quota = reinterpret_cast<const uint64_t*>(context);
+		j.set_cpu_quota(quota[0], quota[1]);
+	}
+
+	static void set_parallel(cc0::job &j, void *context)
+	{
+		j.set_parallel_children(*reinterpret_cast<const bool*>(context));
+	}
+
+	static void set_paused(cc0::job &j, void *context)
+	{
+		if (*reinterpret_cast<const bool*>(context)) {
+			j.pause();
+		} else {
+			j.resume();
+		}
+	}
+
+	static void set_frozen(cc0::job &j, void *context)
+	{
+		if (*reinterpret_cast<const bool*>(context)) {
+			j.freeze();
+		} else {
+			j.thaw();
+		}
+	}
+
+	static void set_stats(cc0::job &j, void *context)
+	{
+		const char *const *args = reinterpret_cast<const char *const*>(context);
+		j.publish_stats(std::strcmp(args[0], "off") != 0 ? args[0] : nullptr, args[1] != nullptr ? std::strtoull(args[1], nullptr, 10) : 1);
+	}
+
+	static bool parse(const char *text, uint64_t &value)
+	{
+		char *end = nullptr;
+		errno = 0;
+		value = std::strtoull(text, &end, 10);
+		return text[0] != '-' && end != text && *end == 0 && errno == 0;
+	}
+
+	static bool parse(const char *text, float &value)
+	{
+		char *end = nullptr;
+		const double d = std::strtod(text, &end);
+		value = static_cast<float>(d);
+		return end != text && *end == 0 && std::isfinite(d) && d > 0.0 && d < double(1ULL << 47ULL); // Time scales are converted to 16.16 fixed point, so larger values do not fit.
+	}
+
+	static void reply(int out, const char *text)
+	{
+#if defined(__linux__)
+		::send(out, text, std::strlen(text), MSG_DONTWAIT | MSG_NOSIGNAL); // Replies that do not fit in the socket buffer are dropped rather than blocking the ticking thread.
+#endif
+	}
+
+	static void execute(cc0::job &root, char *line, int out)
+	{
+		const char *args[5] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+		uint64_t n = 0;
+		for (char *token = std::strtok(line, " \t\r"); token != nullptr && n < 5; token = std::strtok(nullptr, " \t\r")) {
+			args[n++] = token;
+		}
+		uint64_t count = 0;
+		uint64_t numbers[2] = { 0, 0 };
+		float scale = 0.0f;
+		if (n == 0) {
+			return;
+		} else if (std::strcmp(args[0], "tick_rate") == 0 && n == 4) {
+			if (!parse(args[2], numbers[0]) || !parse(args[3], numbers[1])) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			if ((numbers[0] == 0) != (numbers[1] == 0) || numbers[0] > numbers[1]) {
+				reply(out, "error invalid range\n"); // Both zero removes the limit. Otherwise both are divisors.
+				return;
+			}
+			count = select(root, args[1], set_tick_rate, numbers);
+		} else if (std::strcmp(args[0], "time_scale") == 0 && n == 3) {
+			if (!parse(args[2], scale)) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			count = select(root, args[1], set_time_scale, &scale);
+		} else if (std::strcmp(args[0], "max_ticks") == 0 && n == 3) {
+			if (!parse(args[2], numbers[0])) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			count = select(root, args[1], set_max_ticks, numbers);
+		} else if (std::strcmp(args[0], "cpu_quota") == 0 && n == 4) {
+			if (!parse(args[2], numbers[0]) || !parse(args[3], numbers[1])) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			count = select(root, args[1], set_cpu_quota, numbers);
+		} else if (std::strcmp(args[0], "parallel") == 0 && n == 3) {
+			bool enable = std::strcmp(args[2], "on") == 0;
+			count = select(root, args[1], set_parallel, &enable);
+		} else if (std::strcmp(args[0], "pause") == 0 && n == 3) {
+			bool enable = std::strcmp(args[2], "on") == 0;
+			count = select(root, args[1], set_paused, &enable);
+		} else if (std::strcmp(args[0], "freeze") == 0 && n == 3) {
+			bool enable = std::strcmp(args[2], "on") == 0;
+			count = select(root, args[1], set_frozen, &enable);
+		} else if (std::strcmp(args[0], "stats") == 0 && (n == 3 || n == 4)) {
+			if (n == 4 && !parse(args[3], numbers[0])) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			count = select(root, args[1], set_stats, args + 2);
+		} else if (std::strcmp(args[0], "workers") == 0 && n == 2) {
+			if (!parse(args[1], numbers[0])) {
+				reply(out, "error invalid number\n");
+				return;
+			}
+			cc0::jobs_internal::set_worker_count(numbers[0]);
+			count = cc0::jobs_internal::get_worker_count();
+		} else {
+			reply(out, "error unknown command\n");
+			return;
+		}
+		char text[CONTROL_LINE_SIZE];
+		std::snprintf(text, sizeof(text), "ok %llu\n", static_cast<unsigned long long>(count));
+		reply(out, text);
+	}
+
+	void poll(cc0::job &root)
+	{
+#if defined(__linux__)
+		for (int client = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); client >= 0; client = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) {
+			uint64_t i = 0;
+			while (i < CONTROL_MAX_CLIENTS && clients[i].fd >= 0) {
+				++i;
+			}
+			if (i == CONTROL_MAX_CLIENTS) {
+				::close(client);
+				continue;
+			}
+			clients[i].fd = client;
+			clients[i].length = 0;
+			clients[i].overflow = false;
+		}
+		for (uint64_t i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+			control_client &c = clients[i];
+			for (uint64_t reads = 0; c.fd >= 0 && reads < CONTROL_MAX_READS; ++reads) {
+				char buffer[CONTROL_LINE_SIZE];
+				const ssize_t received = ::recv(c.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+				if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+					::close(c.fd);
+					c.fd = -1;
+				}
+				if (received <= 0) {
+					break;
+				}
+				for (ssize_t b = 0; b < received; ++b) {
+					if (buffer[b] == '\n') {
+						if (c.overflow) {
+							reply(c.fd, "error line too long\n");
+						} else {
+							c.line[c.length] = 0;
+							execute(root, c.line, c.fd);
+						}
+						c.length = 0;
+						c.overflow = false;
+					} else if (c.length < CONTROL_LINE_SIZE - 1) {
+						c.line[c.length++] = buffer[b];
+					} else {
+						c.overflow = true; // Executing a truncated command could do something else than intended.
+					}
+				}
+			}
+		}
+#endif
+	}
+};
+
+bool cc0::job::open_control_socket(const char *path)
+{
+	if (m_extension != nullptr) {
+		delete m_extension->control;
+		m_extension->control = nullptr;
 	}
+#if defined(__linux__)
+	if (path == nullptr) {
+		return true;
+	}
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path)) {
+		return false;
+	}
+	std::strcpy(address.sun_path, path);
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat status;
+	if (::lstat(path, &status) == 0 && (!S_ISSOCK(status.st_mode) || ::unlink(path) != 0)) { // Only remove a socket left behind by a previous process, never any other file.
+		::close(fd);
+		return false;
+	}
+	// Only the owner may connect. Connections are refused until listening starts, so the permissions are in place before anyone can connect.
+	if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		::close(fd);
+		return false;
+	}
+	if (::chmod(path, 0600) != 0 || ::listen(fd, CONTROL_MAX_CLIENTS) != 0) {
+		::close(fd);
+		::unlink(path);
+		return false;
+	}
+	control_socket *control = new control_socket;
+	control->path = new char[std::strlen(path) + 1];
+	std::strcpy(control->path, path);
+	control->fd = fd;
+	extend().control = control;
+	return true;
+#else
+	return path == nullptr;
+#endif
 }
 
-void cc0::job::delete_killed_children(cc0::job *&child)
+void cc0::job::poll_control_socket( void )
 {
-	if (child != nullptr) {
-		delete_killed_children(child->m_sibling);
-		if (child->is_killed()) {
-			job *sibling = child->m_sibling; // Save the next child in the list.
-			child->m_sibling = nullptr;      // Set this to null to prevent recursive deletion of all subsequent siblings.
-			delete child;                    // Delete the current child only.
-			child = sibling;                 // Refer the current child node to the next child in the child list. This also repairs the linked list since the child pointer is a reference.
+	if (m_extension != nullptr && m_extension->control != nullptr) {
+		m_extension->control->poll(*this);
+	}
+}
+
+static uint64_t thread_cpu_ns( void )
+{
+#if defined(__linux__)
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return uint64_t(t.tv_sec) * NS_PER_SEC + uint64_t(t.tv_nsec);
+#else
+	return now_ns();
+#endif
+}
+
+struct cc0::job::cpu_quota
+{
+	uint64_t quota_ns;   // The processor time allowed within each window.
+	uint64_t window_ns;  // The length of the window.
+	uint64_t used_ns;    // The processor time used within the current window.
+	uint64_t updated_ns; // The real time at which the used processor time was last refilled.
+	bool     throttled;  // Indicates that the most recent cycle was deferred.
+
+	bool refill( void )
+	{
+		// Usage drains at the rate of the quota, which approximates a sliding window without keeping a log of cycles.
+		const uint64_t t = now_ns();
+		const uint64_t refilled_ns = uint64_t(double(t - updated_ns) * double(quota_ns) / double(window_ns));
+		if (refilled_ns >= used_ns) {
+			used_ns = 0;
+			updated_ns = t;
+		} else if (refilled_ns > 0) {
+			// Only the time that accounts for the refill is consumed, so that frequent refills do not lose the remainder to truncation.
+			used_ns -= refilled_ns;
+			updated_ns += uint64_t(double(refilled_ns) * double(window_ns) / double(quota_ns));
+		}
+		throttled = used_ns >= quota_ns;
+		return !throttled;
+	}
+};
+
+struct lane_context
+{
+	cc0::job           **children;    // The children grouped by lane.
+	uint64_t            *offsets;     // The index of the first child of each lane, followed by the total number of children.
+	uint64_t             duration_ns; // The time elapsed.
+	event_queue        **queues;      // The event queue of the thread that executed each lane.
+	speculation_record  *records;     // The outcome of ticking each child speculatively. Null if the children are not ticked speculatively.
+	cc0::jobs_internal::scratch_arena **arenas; // The arena of the thread cycling the root, followed by the arena of the thread that executed each lane.
+};
+
+void cc0::job::tick_lane(void *context, uint64_t lane, uint64_t, uint64_t)
+{
+	lane_context &ctx = *reinterpret_cast<lane_context*>(context);
+	cc0::jobs_internal::scratch_arena &arena = cc0::jobs_internal::scratch_arena::instance();
+	arena.enter();
+	if (&arena != ctx.arenas[0]) {
+		arena.lend(); // Memory allocated by the children must outlive the lane, so the arena is released by the thread cycling the root.
+	}
+	for (uint64_t i = ctx.offsets[lane]; i < ctx.offsets[lane + 1]; ++i) {
+		cc0::job *c = ctx.children[i];
+		const uint64_t start_ns = now_ns();
+		if (ctx.records != nullptr && !c->save_subtree()) {
+			// The child has data that can not be undone, so it is ticked after the parallel children instead of risking a conflict.
+			ctx.records[i].first_event = ctx.records[i].last_event = 0;
+			ctx.records[i].changes = 0;
+			ctx.records[i].conflict = false;
+			ctx.records[i].serial = true;
+			continue;
+		}
+		if (ctx.records != nullptr) {
+			g_speculation.first_event = g_event_queue.count;
+			g_speculation.changes = 0;
+			g_speculation.conflict = false;
+			g_speculation.serial = false;
+			cc0::jobs_internal::speculation_root = c;
+			c->cycle(ctx.duration_ns);
+			cc0::jobs_internal::speculation_root = nullptr;
+			g_speculation.last_event = g_event_queue.count;
+			ctx.records[i] = g_speculation;
+		} else {
+			c->cycle(ctx.duration_ns);
+		}
+		const uint64_t cost_ns = now_ns() - start_ns;
+		c->m_cost_ns = c->m_cost_ns - (c->m_cost_ns >> 3) + (cost_ns >> 3);
+	}
+	ctx.queues[lane] = &g_event_queue;
+	ctx.arenas[lane + 1] = &arena;
+	arena.leave();
+}
+
+void cc0::job::tick_children_in_parallel(uint64_t duration_ns)
+{
+	const uint64_t lanes = cc0::jobs_internal::get_worker_count() + 1;
+	if (needs_rebalance(lanes)) {
+		rebalance(lanes);
+	}
+	uint64_t *counts = cc0::job::scratch_new<uint64_t>(lanes);
+	lane_context ctx;
+	ctx.offsets = cc0::job::scratch_new<uint64_t>(lanes + 1);
+	ctx.queues = cc0::job::scratch_new<event_queue*>(lanes);
+	ctx.duration_ns = duration_ns;
+	ctx.children = nullptr;
+	ctx.records = nullptr;
+	ctx.arenas = cc0::job::scratch_new<cc0::jobs_internal::scratch_arena*>(lanes + 1);
+	ctx.arenas[0] = &cc0::jobs_internal::scratch_arena::instance();
+	for (cc0::job *first = m_child; first != nullptr && is_active();) {
+		// Children are sorted by dependency level, so every level is ticked in parallel, one level after the other.
+		cc0::job *last = first;
+		uint64_t n = 0;
+		for (uint64_t l = 0; l < lanes; ++l) {
+			counts[l] = 0;
+		}
+		for (; last != nullptr && last->m_dependency_level == first->m_dependency_level; last = last->m_sibling) {
+			++counts[last->m_lane];
+			++n;
+		}
+		ctx.children = cc0::job::scratch_new<cc0::job*>(n);
+		ctx.offsets[0] = 0;
+		for (uint64_t l = 0; l < lanes; ++l) {
+			ctx.offsets[l + 1] = ctx.offsets[l] + counts[l];
+			counts[l] = ctx.offsets[l];
+			ctx.queues[l] = nullptr;
+			ctx.arenas[l + 1] = nullptr;
+		}
+		for (cc0::job *c = first; c != last; c = c->m_sibling) {
+			ctx.children[counts[c->m_lane]++] = c;
+		}
+		ctx.records = m_speculative_children ? cc0::job::scratch_new<speculation_record>(n) : nullptr;
+		cc0::jobs_internal::parallel_lanes(lanes, tick_lane, &ctx);
+		if (ctx.records != nullptr) {
+			// Events queued by conflicting children are sent again when the children are ticked again.
+			for (uint64_t l = 0; l < lanes; ++l) {
+				for (uint64_t i = ctx.offsets[l]; i < ctx.offsets[l + 1]; ++i) {
+					if (ctx.records[i].conflict) {
+						ctx.queues[l]->cancel(ctx.records[i].first_event, ctx.records[i].last_event);
+					}
+				}
+			}
+		}
+		for (uint64_t l = 0; l < lanes; ++l) {
+			if (ctx.queues[l] != nullptr && ctx.queues[l] != &g_event_queue) {
+				g_event_queue.append(*ctx.queues[l]); // Events queued on worker threads are delivered by the thread that cycles the root.
+			}
+			if (ctx.arenas[l + 1] != nullptr && ctx.arenas[l + 1] != ctx.arenas[0]) {
+				ctx.arenas[0]->borrow(*ctx.arenas[l + 1]);
+			}
+		}
+		if (ctx.records != nullptr) {
+			// All conflicting children are undone before any of them is ticked again, since they may access each other.
+			for (uint64_t i = 0; i < n; ++i) {
+				if (ctx.records[i].conflict) {
+					ctx.children[i]->undo_subtree();
+				} else if (ctx.records[i].changes > 0) {
+					ctx.children[i]->commit_subtree();
+				}
+			}
+			for (uint64_t i = 0; i < n && is_active(); ++i) {
+				if (ctx.records[i].conflict || ctx.records[i].serial) {
+					ctx.children[i]->cycle(duration_ns);
+				}
+			}
 		}
+		first = last;
+	}
+	// Children may have added listening jobs to their sub-trees concurrently, so collect their events again.
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		add_subtree_bloom(c->m_subtree_bloom);
 	}
 }
 
 void cc0::job::tick_children(uint64_t duration_ns)
 {
+	if (m_schedule_dirty) {
+		// The sorted order is kept until the structure changes or children are deferred. Removing children never invalidates it.
+		bool deferred = false;
+		for (const cc0::job *c = m_child; c != nullptr && !deferred; c = c->m_sibling) {
+			deferred = c->m_deferrals > 0;
+		}
+		if (update_dependency_levels() || m_schedule != SCHEDULE_IN_ORDER || deferred) {
+			m_child = sort_siblings(m_child, m_schedule);
+		}
+		m_schedule_dirty = false;
+	}
+	if ((m_parallel_children || m_speculative_children) && cc0::jobs_internal::speculation_root == nullptr && m_child != nullptr && m_child->m_sibling != nullptr && cc0::jobs_internal::get_worker_count() > 0) {
+		tick_children_in_parallel(duration_ns);
+		return;
+	}
+	const uint64_t budget_ns = get_child_budget_ns();
+	const uint64_t start_ns = budget_ns > 0 ? now_ns() : 0;
+	// Siblings are fetched two steps ahead so that their cache misses overlap with ticking the current child.
+	if (m_child != nullptr) {
+		prefetch(m_child->m_sibling);
+	}
 	for (cc0::job *c = m_child; c != nullptr && is_active(); c = c->m_sibling) {
+		if (budget_ns > 0 && c != m_child && now_ns() - start_ns >= budget_ns) {
+			// Out of budget. The remaining children catch up on the elapsed time the next time they tick, and age so that they tick earlier.
+			for (; c != nullptr; c = c->m_sibling) {
+				c->m_accumulated_duration_ns += scale_time(duration_ns, c->m_time_scale);
+				++c->m_deferrals;
+			}
+			m_schedule_dirty = true;
+			break;
+		}
+		if (c->m_deferrals > 0) {
+			c->m_deferrals = 0;
+			m_schedule_dirty = true;
+		}
+		const cc0::job *n = c->m_sibling;
+		if (n != nullptr) {
+			prefetch(n->m_sibling);
+		}
 		c->cycle(duration_ns);
 	}
 }
 
-void cc0::job::get_notified(const char *event, cc0::job &sender)
+void cc0::job::get_notified(const char *event, cc0::job &sender, const cc0::job::payload &data)
 {
+	if (CC0_JOBS_ATOMIC_LOAD(m_shared->deleted)) {
+		return; // Being destroyed. The callbacks may belong to derived parts that no longer exist.
+	}
+	const extension *e = m_extension;
+	if (e != nullptr && e->awaited_event != nullptr && (e->awaited_sender == 0 || e->awaited_sender == sender.get_job_id()) && std::strcmp(e->awaited_event, event) == 0) {
+		wake();
+	}
 	if (is_active()) {
 		callback_tree *t = m_event_callbacks.get(0);
-		if (t != nullptr) {
-			callback *c = t->get(event);
-			if (c != nullptr) {
-				(*c)(sender);
-			}
+		callback *c = t != nullptr ? t->get(event) : nullptr;
+		if (c == nullptr) {
+			c = get_type_callback(object_id(), event); // Listeners added to the instance override listeners declared for the type.
+		}
+		if (c != nullptr) {
+			(*c)(*this, sender, data);
 		}
 		t = m_event_callbacks.get(sender.get_job_id());
 		if (t != nullptr) {
-			callback *c = t->get(event);
+			c = t->get(event);
 			if (c != nullptr) {
-				(*c)(sender);
+				(*c)(*this, sender, data);
 			}
 		}
 	}
 }
 
+const char *cc0::job::completion_event( void )
+{
+	return "cc0::job::complete";
+}
+
+void cc0::job::add_completion_waiter(cc0::job &waiter)
+{
+	if (cc0::jobs_internal::speculation_root != nullptr && !track_access(this)) {
+		return;
+	}
+	for (completion_waiter *w = m_shared->waiters; w != nullptr; w = w->next) {
+		if (w->waiter.get_job() == &waiter) {
+			return;
+		}
+	}
+	completion_waiter *w = new completion_waiter;
+	w->waiter.set_ref(&waiter);
+	w->next = m_shared->waiters;
+	m_shared->waiters = w;
+}
+
+void cc0::job::complete( void )
+{
+	m_shared->completed = true;
+	while (m_shared->waiters != nullptr) {
+		completion_waiter *w = m_shared->waiters;
+		m_shared->waiters = w->next;
+		cc0::job *j = w->waiter.get_job();
+		if (j != nullptr) {
+			j->get_notified(completion_event(), *this, m_shared->result);
+			j->ignore(completion_event(), *this);
+		}
+		delete w;
+	}
+}
+
+uint64_t cc0::job::event_bloom(const char *event)
+{
+	uint64_t sum = 0xcbf29ce484222325ULL;
+	for (uint64_t i = 0; event[i] != 0; ++i) {
+		sum ^= uint64_t(event[i]);
+		sum *= 0x100000001b3ULL;
+	}
+	return (1ULL << (sum & 63ULL)) | (1ULL << ((sum >> 6ULL) & 63ULL));
+}
+
+void cc0::job::add_listen_bloom(uint64_t bloom)
+{
+	m_listen_bloom |= bloom;
+	add_subtree_bloom(bloom);
+}
+
+void cc0::job::add_subtree_bloom(uint64_t bloom)
+{
+	// Lanes ticking in parallel may share ancestors, so the filters are updated atomically.
+	for (cc0::job *j = this; j != nullptr && (CC0_JOBS_ATOMIC_LOAD(j->m_subtree_bloom) & bloom) != bloom; j = j->m_parent) {
+		CC0_JOBS_ATOMIC_OR(j->m_subtree_bloom, bloom); // Ancestors always contain the events of their decendants, so stop once an ancestor already contains the event.
+	}
+}
+
+void cc0::job::rebuild_listen_bloom( void )
+{
+	struct event_fn
+	{
+		uint64_t bloom;
+		event_fn( void ) : bloom(0) {}
+		void operator()(const char *const &event, callback&) {
+			bloom |= event_bloom(event);
+		}
+	} events;
+	struct sender_fn
+	{
+		event_fn *events;
+		sender_fn(event_fn *e) : events(e) {}
+		void operator()(const uint64_t&, callback_tree &t) {
+			t.traverse_keys(*events);
+		}
+	} senders(&events);
+	m_event_callbacks.traverse_keys(senders);
+	events.bloom |= get_type_bloom(object_id());
+	if ((m_listen_bloom & ~events.bloom) != 0) {
+		mark_bloom_dirty();
+	}
+	m_listen_bloom = events.bloom;
+}
+
+cc0::job::type_listeners *cc0::job::get_type_listeners(uint64_t type_id, bool create)
+{
+	// Function-local so that classes can declare listeners regardless of static initialization order.
+	static type_tree types;
+	type_listeners *t = types.get(type_id);
+	if (t == nullptr && create) {
+		t = types.add(type_id, type_listeners());
+	}
+	return t;
+}
+
+cc0::job::callback *cc0::job::get_type_callback(uint64_t type_id, const char *event)
+{
+	for (type_listeners *t = get_type_listeners(type_id, false); t != nullptr; t = get_type_listeners(t->base_id, false)) {
+		callback *c = t->callbacks.get(event);
+		if (c != nullptr) {
+			return c;
+		}
+	}
+	return nullptr;
+}
+
+uint64_t cc0::job::get_type_bloom(uint64_t type_id)
+{
+	uint64_t bloom = 0;
+	for (type_listeners *t = get_type_listeners(type_id, false); t != nullptr; t = get_type_listeners(t->base_id, false)) {
+		bloom |= t->bloom;
+	}
+	return bloom;
+}
+
+void cc0::job::mark_bloom_dirty( void )
+{
+	for (cc0::job *j = this; j != nullptr && !CC0_JOBS_ATOMIC_LOAD(j->m_bloom_dirty); j = j->m_parent) {
+		CC0_JOBS_ATOMIC_STORE(j->m_bloom_dirty, true);
+	}
+}
+
+void cc0::job::update_subtree_bloom( void )
+{
+	if (m_bloom_dirty) {
+		m_subtree_bloom = m_listen_bloom;
+		for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+			c->update_subtree_bloom();
+			m_subtree_bloom |= c->m_subtree_bloom;
+		}
+		m_bloom_dirty = false;
+	}
+}
+
+void cc0::job::broadcast(const char *event, uint64_t bloom, cc0::job &sender, const cc0::job::payload &data)
+{
+	if (cc0::jobs_internal::speculation_root != nullptr && !track_access(this)) {
+		return;
+	}
+	update_subtree_bloom();
+	if ((m_subtree_bloom & bloom) == bloom) {
+		if ((m_listen_bloom & bloom) == bloom) {
+			sender.send(event, *this, data);
+		}
+		for (cc0::job *c = m_child; c != nullptr && sender.is_active(); c = c->m_sibling) {
+			c->broadcast(event, bloom, sender, data);
+		}
+	}
+}
+
 uint64_t cc0::job::scale_time(uint64_t time, uint64_t time_scale)
 {
 	return (time * time_scale) >> 16ULL;
@@ -436,6 +3115,19 @@ void cc0::job::on_birth( void )
 void cc0::job::on_death( void )
 {}
 
+void cc0::job::set_hooks(cc0::job &j, bool tick, bool tock, uint64_t size, uint64_t align, uint64_t type_id)
+{
+	j.m_tick_hook = tick;
+	j.m_tock_hook = tock;
+	j.m_object_size = size;
+	j.m_object_align = align;
+	j.update_state_registered();
+	j.add_listen_bloom(get_type_bloom(type_id)); // Applied on construction so that declared listeners are reached by broadcasts regardless of how the job joins a tree.
+}
+
+void cc0::job::set_hooks(cc0::jobs_internal::rtti&, bool, bool, uint64_t, uint64_t, uint64_t)
+{}
+
 cc0::job::job( void ) :
 	m_parent(nullptr), m_sibling(nullptr), m_child(nullptr),
 	m_job_id(cc0::jobs_internal::new_uuid()),
@@ -445,93 +3137,218 @@ cc0::job::job( void ) :
 	m_min_duration_ns(0), m_max_duration_ns(UINT64_MAX), m_accumulated_duration_ns(m_min_duration_ns), m_max_ticks_per_cycle(1),
 	m_time_scale(1ULL << 16ULL),
 	m_event_callbacks(),
-	m_shared(new shared{ 0, false }),
+	m_components(),
+	m_shared(new shared),
+	m_extension(nullptr),
+	m_listen_bloom(0), m_subtree_bloom(0),
+	m_priority(0), m_deferrals(0),
+	m_dependency_level(0),
+	m_cost_ns(0), m_lane(UINT64_MAX),
+	m_object_size(sizeof(cc0::job)), m_object_align(alignof(cc0::job)),
+	m_schedule(SCHEDULE_IN_ORDER), m_delivery(DELIVER_IMMEDIATELY), m_bloom_dirty(false), m_schedule_dirty(false), m_parallel_children(false), m_speculative_children(false), m_speculative(false), m_kill_pending(false), m_paused(false), m_frozen(false), m_tick_hook(true), m_tock_hook(true), m_state_registered(true),
 	m_enabled(true), m_kill(false), m_waiting(false), m_tick_lock(false)
 {}
 
-cc0::job::~job( void )
-{
+cc0::job::~job( void )
+{
+	// The derived parts of the job are already destroyed, so refs stop resolving to it before anything is notified, including waiters among its own children.
+	set_deleted();
+	if (!m_shared->completed) {
+		complete(); // Jobs waiting for this job would otherwise never wake up.
+	}
+	detach_components();
+
+	if (m_extension != nullptr) {
+		extension &e = *m_extension;
+		while (e.dependencies != nullptr) {
+			dependency *d = e.dependencies;
+			e.dependencies = d->next;
+			delete d;
+		}
+		while (e.state != nullptr) {
+			state_region *r = e.state;
+			e.state = r->next;
+			delete r;
+		}
+		cc0::jobs_internal::deallocate(e.undo, e.undo_size);
+		e.undo = nullptr;
+		cc0::jobs_internal::deallocate(e.recorded, e.recorded_size);
+		e.recorded = nullptr;
+		if (e.history != nullptr) {
+			delete e.history;
+			e.history = nullptr;
+			set_recorder(m_parent != nullptr ? m_parent->find_history() : nullptr); // The children are deleted below, and must not record their deaths in the deleted history.
+		}
+		delete e.publisher;
+		e.publisher = nullptr;
+		delete e.control;
+		e.control = nullptr;
+		delete e.quota;
+		e.quota = nullptr;
+	}
+
 	delete m_child;
 	m_child = nullptr;
 	delete m_sibling;
 	m_sibling = nullptr;
+	delete m_extension; // Deleted last, since the children may still look up the history of their ancestors.
+	m_extension = nullptr;
 
-	set_deleted();
-	if (m_shared->watchers == 0) {
+	if (CC0_JOBS_ATOMIC_SUB(m_shared->watchers, 1) == 0) { // The job holds a reference of its own, so exactly one of the job and its last watcher frees the shared data.
 		delete m_shared;
-		m_shared = nullptr;
 	}
+	m_shared = nullptr;
 }
 
-void cc0::job::cycle(uint64_t duration_ns)
+void cc0::job::perform_ticks(uint64_t duration_ns)
 {
-	if (!m_tick_lock) {
-		m_tick_lock = true;
-		m_waiting = false;
+	m_waiting = false;
 
-		duration_ns = scale_time(duration_ns, m_time_scale);
-		m_accumulated_duration_ns += duration_ns;
+	duration_ns = scale_time(duration_ns, m_time_scale);
+	m_accumulated_duration_ns += duration_ns;
 
-		const uint64_t min_dur_ns = m_min_duration_ns; // Save these so that child jobs can not affect, and break, the current ticking process.
-		const uint64_t max_dur_ns = m_max_duration_ns;
+	const uint64_t min_dur_ns = m_min_duration_ns; // Save these so that child jobs can not affect, and break, the current ticking process.
+	const uint64_t max_dur_ns = m_max_duration_ns;
 
-		for (uint64_t i = m_max_ticks_per_cycle; i > 0; --i) {
+	for (uint64_t i = m_max_ticks_per_cycle; i > 0; --i) {
 
-			duration_ns = m_accumulated_duration_ns > max_dur_ns ? max_dur_ns : m_accumulated_duration_ns;
+		duration_ns = m_accumulated_duration_ns > max_dur_ns ? max_dur_ns : m_accumulated_duration_ns;
 
-			m_existed_for_ns += duration_ns;
-			++m_existed_tick_count;
+		m_existed_for_ns += duration_ns;
+		++m_existed_tick_count;
 
-			if (is_sleeping()) {
-				// TODO: Unsure if m_sleep_ns needs to be scaled or not...
-				if (m_sleep_ns <= duration_ns) {
-					m_sleep_ns = 0;
-					duration_ns -= m_sleep_ns;
-				} else {
-					m_sleep_ns -= duration_ns;
-					duration_ns = 0;
-				}
+		if (is_sleeping()) {
+			// TODO: Unsure if m_sleep_ns needs to be scaled or not...
+			if (m_sleep_ns <= duration_ns) {
+				m_sleep_ns = 0;
+				duration_ns -= m_sleep_ns;
+			} else {
+				m_sleep_ns -= duration_ns;
+				duration_ns = 0;
 			}
+		}
 
-			if (duration_ns < min_dur_ns) {
-				m_tick_lock = false;
-				m_waiting = true;
-				return;
-			}
-			m_accumulated_duration_ns -= duration_ns;
+		if (duration_ns < min_dur_ns) {
+			m_waiting = true;
+			return;
+		}
+		m_accumulated_duration_ns -= duration_ns;
 
-			if (is_active()) {
-				m_active_for_ns += duration_ns;
-				++m_active_tick_count;
+		if (is_active()) {
+			m_active_for_ns += duration_ns;
+			++m_active_tick_count;
+			if (m_tick_hook) {
 				on_tick(duration_ns);
 			}
+		}
 
+		// Jobs without children, and without overridden hooks, only update their counters.
+		if (m_child != nullptr) {
 			tick_children(duration_ns);
 
 			delete_killed_children(m_child);
+		}
 
-			if (is_active()) {
-				on_tock(duration_ns);
-			}
+		if (m_tock_hook && is_active()) {
+			on_tock(duration_ns);
+		}
+	}
+
+	m_accumulated_duration_ns = max_dur_ns > 0 ? m_accumulated_duration_ns % max_dur_ns : 0;
+}
+
+bool cc0::job::skip_cycle(uint64_t duration_ns)
+{
+	if (m_frozen) {
+		return true;
+	}
+	if (m_paused) {
+		// The sub-tree catches up on the elapsed time once resumed.
+		m_accumulated_duration_ns += scale_time(duration_ns, m_time_scale);
+		return true;
+	}
+	extension *e = m_extension;
+	if (e == nullptr) {
+		return false;
+	}
+	if (e->awaited_event != nullptr) {
+		// Jobs waiting for an event are skipped together with their sub-tree until the event arrives or the wait times out.
+		const uint64_t scaled_ns = scale_time(duration_ns, m_time_scale);
+		if (e->wait_ns > scaled_ns) {
+			e->wait_ns -= scaled_ns;
+			return true;
 		}
+		wake();
+	}
+	if (e->quota != nullptr && !m_tick_lock && !e->quota->refill()) {
+		// Over quota. The job catches up on the elapsed time once it is back within its quota.
+		m_accumulated_duration_ns += scale_time(duration_ns, m_time_scale);
+		return true;
+	}
+	return false;
+}
 
-		m_accumulated_duration_ns = max_dur_ns > 0 ? m_accumulated_duration_ns % max_dur_ns : 0;
-		m_tick_lock = false;
+void cc0::job::cycle(uint64_t duration_ns)
+{
+	const bool skipped = skip_cycle(duration_ns);
+	if (m_tick_lock || (skipped && m_parent != nullptr)) {
+		return;
+	}
+	m_tick_lock = true;
+	const uint64_t start_ns = m_extension != nullptr && m_extension->publisher != nullptr ? now_ns() : 0;
+	const uint64_t start_cpu_ns = m_extension != nullptr && m_extension->quota != nullptr ? thread_cpu_ns() : UINT64_MAX;
+	if (m_parent == nullptr) {
+		// A root that sits out the cycle still ends it, so that events queued and values buffered from outside the tree are not held back.
+		cc0::jobs_internal::scratch_arena &arena = cc0::jobs_internal::scratch_arena::instance();
+		arena.enter();
+		if (!skipped) {
+			perform_ticks(duration_ns);
+		}
+		if (arena.is_outermost()) {
+			end_root_cycle();
+		}
+		arena.leave();
+	} else {
+		perform_ticks(duration_ns);
+	}
+	if (!skipped && m_extension != nullptr) {
+		extension &e = *m_extension;
+		if (e.quota != nullptr && start_cpu_ns != UINT64_MAX) {
+			e.quota->used_ns += thread_cpu_ns() - start_cpu_ns;
+		}
+		if (e.history != nullptr) {
+			e.history->close(*this);
+		}
+		if (e.publisher != nullptr) {
+			e.publisher->publish(*this, now_ns() - start_ns);
+		}
 	}
+	m_tick_lock = false;
 }
 
 void cc0::job::kill( void )
 {
 	if (is_alive()) {
+		if (cc0::jobs_internal::speculation_root != nullptr) {
+			// Killing can not be undone, so it waits until the speculative tick is committed.
+			m_kill_pending = m_kill_pending || track_change(this);
+			return;
+		}
+
 		kill_children();
 
-		delete m_child;
-		m_child = nullptr;
+		if (find_history() == nullptr) {
+			delete m_child; // Killed children are kept with the job if it may be revived.
+			m_child = nullptr;
+		}
+		mark_bloom_dirty();
 
 		on_death();
 
 		m_enabled = false;
 		m_kill    = true;
+
+		complete();
 	}
 }
 
@@ -550,6 +3367,38 @@ void cc0::job::sleep_for(uint64_t duration_ns)
 void cc0::job::wake( void )
 {
 	m_sleep_ns = 0;
+	if (m_extension != nullptr) {
+		m_extension->awaited_event = nullptr;
+		m_extension->awaited_sender = 0;
+		m_extension->wait_ns = 0;
+	}
+}
+
+void cc0::job::sleep_until_event(const char *event, uint64_t timeout_ns)
+{
+	if (event != nullptr && timeout_ns > 0) {
+		extension &e = extend();
+		e.wait_ns = timeout_ns;
+		e.awaited_event = event;
+		e.awaited_sender = 0;
+		add_listen_bloom(event_bloom(event)); // Make sure broadcasts reach the job even if it does not listen to the event.
+	}
+}
+
+void cc0::job::sleep_until_event(const char *event, const cc0::job &sender, uint64_t timeout_ns)
+{
+	sleep_until_event(event, timeout_ns);
+	if (is_waiting_for_event()) {
+		m_extension->awaited_sender = sender.get_job_id();
+	}
+}
+
+void cc0::job::sleep_until_complete(cc0::job &target, uint64_t timeout_ns)
+{
+	if (!target.is_complete()) {
+		target.add_completion_waiter(*this);
+		sleep_until_event(completion_event(), target, timeout_ns);
+	}
 }
 
 void cc0::job::ignore(const char *event)
@@ -558,6 +3407,13 @@ void cc0::job::ignore(const char *event)
 	if (t != nullptr) {
 		t->remove(event);
 	}
+	if (get_type_callback(object_id(), event) != nullptr) {
+		if (t == nullptr) {
+			t = m_event_callbacks.add(0, callback_tree());
+		}
+		t->add(event, callback()); // An empty callback overrides the listener declared for the type.
+	}
+	rebuild_listen_bloom();
 }
 
 void cc0::job::ignore(const char *event, const cc0::job &sender)
@@ -565,24 +3421,33 @@ void cc0::job::ignore(const char *event, const cc0::job &sender)
 	callback_tree *t = m_event_callbacks.get(sender.get_job_id());
 	if (t != nullptr) {
 		t->remove(event);
+		rebuild_listen_bloom();
 	}
 }
 
 void cc0::job::ignore(const cc0::job &sender)
 {
 	m_event_callbacks.remove(sender.get_job_id());
+	rebuild_listen_bloom();
 }
 
 cc0::job *cc0::job::add_child(const char *type_name)
 {
 	cc0::job *p = nullptr;
-	if (!is_killed()) {
+	if (!is_killed() && (cc0::jobs_internal::speculation_root == nullptr || track_change(this))) {
 		p = create_orphan(type_name);
 		if (p != nullptr) {
 			add_sibling(m_child, p);
+			p->m_speculative = cc0::jobs_internal::speculation_root != nullptr;
+			if (!p->m_speculative) {
+				p->record_spawn();
+			}
 			p->m_created_at_ns = get_local_time_ns();
 			p->m_min_duration_ns = m_min_duration_ns;
 			p->m_max_duration_ns = m_max_duration_ns;
+			p->m_delivery = m_delivery;
+			add_subtree_bloom(p->m_subtree_bloom);
+			m_schedule_dirty = true;
 			p->on_birth();
 		}
 	}
@@ -619,6 +3484,36 @@ bool cc0::job::is_disabled( void ) const
 	return !is_enabled();
 }
 
+void cc0::job::pause( void )
+{
+	m_paused = true;
+}
+
+void cc0::job::resume( void )
+{
+	m_paused = false;
+}
+
+bool cc0::job::is_paused( void ) const
+{
+	return m_paused;
+}
+
+void cc0::job::freeze( void )
+{
+	m_frozen = true;
+}
+
+void cc0::job::thaw( void )
+{
+	m_frozen = false;
+}
+
+bool cc0::job::is_frozen( void ) const
+{
+	return m_frozen;
+}
+
 bool cc0::job::is_sleeping( void ) const
 {
 	return m_sleep_ns > 0;
@@ -629,6 +3524,181 @@ bool cc0::job::is_awake( void ) const
 	return !is_sleeping();
 }
 
+void cc0::job::set_child_schedule(cc0::job::schedule_mode mode)
+{
+	m_schedule_dirty = m_schedule_dirty || mode != m_schedule;
+	m_schedule = mode;
+}
+
+cc0::job::schedule_mode cc0::job::get_child_schedule( void ) const
+{
+	return m_schedule;
+}
+
+void cc0::job::set_priority(int64_t priority)
+{
+	if (priority != m_priority) {
+		m_priority = priority;
+		mark_schedule_dirty();
+	}
+}
+
+void cc0::job::set_parallel_children(bool enable)
+{
+	m_parallel_children = enable;
+}
+
+bool cc0::job::get_parallel_children( void ) const
+{
+	return m_parallel_children;
+}
+
+void cc0::job::pin_to_lane(uint64_t lane)
+{
+	if (lane != UINT64_MAX || m_extension != nullptr) {
+		extend().pinned_lane = lane;
+	}
+}
+
+uint64_t cc0::job::get_pinned_lane( void ) const
+{
+	return m_extension != nullptr ? m_extension->pinned_lane : UINT64_MAX;
+}
+
+void cc0::job::set_speculative_children(bool enable)
+{
+	m_speculative_children = enable;
+}
+
+bool cc0::job::get_speculative_children( void ) const
+{
+	return m_speculative_children;
+}
+
+void cc0::job::register_state(void *data, uint64_t size)
+{
+	if (data != nullptr && size > 0) {
+		state_region **last = &extend().state;
+		while (*last != nullptr) {
+			last = &(*last)->next;
+		}
+		*last = new state_region;
+		(*last)->data = data;
+		(*last)->size = size;
+		(*last)->next = nullptr;
+		update_state_registered();
+	}
+}
+
+bool cc0::job::set_lane_cpu(uint64_t lane, int64_t cpu)
+{
+	return cc0::jobs_internal::set_lane_cpu(lane, cpu);
+}
+
+bool cc0::job::set_lane_realtime_priority(uint64_t lane, int64_t priority)
+{
+	return cc0::jobs_internal::set_lane_realtime_priority(lane, priority);
+}
+
+uint64_t cc0::job::get_tick_cost_ns( void ) const
+{
+	return m_cost_ns;
+}
+
+int64_t cc0::job::get_priority( void ) const
+{
+	return m_priority;
+}
+
+void cc0::job::set_deadline_ns(uint64_t deadline_ns)
+{
+	if (deadline_ns != get_deadline_ns()) {
+		extend().deadline_ns = deadline_ns;
+		mark_schedule_dirty();
+	}
+}
+
+uint64_t cc0::job::get_deadline_ns( void ) const
+{
+	return m_extension != nullptr ? m_extension->deadline_ns : UINT64_MAX;
+}
+
+void cc0::job::set_child_budget_ns(uint64_t budget_ns)
+{
+	if (budget_ns != get_child_budget_ns()) {
+		extend().child_budget_ns = budget_ns;
+	}
+}
+
+uint64_t cc0::job::get_child_budget_ns( void ) const
+{
+	return m_extension != nullptr ? m_extension->child_budget_ns : 0;
+}
+
+bool cc0::job::run_after(cc0::job &sibling)
+{
+	if (&sibling == this || m_parent == nullptr || sibling.m_parent != m_parent) {
+		return false;
+	}
+	extension &e = extend();
+	for (const dependency *d = e.dependencies; d != nullptr; d = d->next) {
+		if (d->target.get_job() == &sibling) {
+			return true;
+		}
+	}
+	dependency *d = new dependency;
+	d->target.set_ref(&sibling);
+	d->next = e.dependencies;
+	e.dependencies = d;
+	mark_schedule_dirty();
+	return true;
+}
+
+void cc0::job::set_cpu_quota(uint64_t quota_ns, uint64_t window_ns)
+{
+	if (quota_ns == 0 || window_ns == 0) {
+		if (m_extension != nullptr) {
+			delete m_extension->quota;
+			m_extension->quota = nullptr;
+		}
+		return;
+	}
+	extension &e = extend();
+	if (e.quota == nullptr) {
+		e.quota = new cpu_quota;
+		e.quota->used_ns = 0;
+		e.quota->updated_ns = now_ns();
+		e.quota->throttled = false;
+	}
+	e.quota->quota_ns = quota_ns;
+	e.quota->window_ns = window_ns;
+}
+
+uint64_t cc0::job::get_cpu_quota_ns( void ) const
+{
+	return m_extension != nullptr && m_extension->quota != nullptr ? m_extension->quota->quota_ns : 0;
+}
+
+uint64_t cc0::job::get_cpu_quota_window_ns( void ) const
+{
+	return m_extension != nullptr && m_extension->quota != nullptr ? m_extension->quota->window_ns : 0;
+}
+
+bool cc0::job::is_throttled( void ) const
+{
+	return m_extension != nullptr && m_extension->quota != nullptr && m_extension->quota->throttled;
+}
+
+bool cc0::job::is_complete( void ) const
+{
+	return m_shared->completed;
+}
+
+bool cc0::job::is_waiting_for_event( void ) const
+{
+	return m_extension != nullptr && m_extension->awaited_event != nullptr;
+}
+
 bool cc0::job::is_active( void ) const
 {
 	return is_enabled() && !is_sleeping();
@@ -654,32 +3724,159 @@ uint64_t cc0::job::get_job_id( void ) const
 	return m_job_id;
 }
 
-void cc0::job::notify_parent(const char *event)
+void cc0::job::send(const char *event, cc0::job &target, const cc0::job::payload &data)
+{
+	if (m_delivery == DELIVER_IMMEDIATELY) {
+		if (cc0::jobs_internal::speculation_root == nullptr || track_access(&target)) {
+			target.get_notified(event, *this, data);
+		}
+	} else {
+		g_event_queue.push(event, *this, target, m_delivery == DELIVER_COALESCED, data);
+	}
+}
+
+void cc0::job::send_parent(const char *event, const cc0::job::payload &data)
 {
 	if (m_parent != nullptr && is_active()) {
-		notify(event, *m_parent);
+		send(event, *m_parent, data);
 	}
 }
 
-void cc0::job::notify_children(const char *event)
+void cc0::job::send_children(const char *event, const cc0::job::payload &data)
 {
 	for (cc0::job *c = m_child; c != nullptr && is_active(); c = c->m_sibling) {
-		notify(event, *c);
+		send(event, *c, data);
 	}
 }
 
-void cc0::job::notify_group(const char *event, cc0::job::query::results &group)
+void cc0::job::send_decendants(const char *event, const cc0::job::payload &data)
+{
+	const uint64_t bloom = event_bloom(event);
+	for (cc0::job *c = m_child; c != nullptr && is_active(); c = c->m_sibling) {
+		c->broadcast(event, bloom, *this, data);
+	}
+}
+
+void cc0::job::send_group(const char *event, cc0::job::query::results &group, const cc0::job::payload &data)
 {
 	query::result *r = group.get_results();
 	while (r != nullptr && is_active()) {
-		notify(event, *r->get_job().get_job());
+		send(event, *r->get_job().get_job(), data);
 		r = r->get_next();
 	}
 }
 
+void cc0::job::notify_parent(const char *event)
+{
+	send_parent(event, payload{ nullptr, 0, 0, 0 });
+}
+
+void cc0::job::notify_children(const char *event)
+{
+	send_children(event, payload{ nullptr, 0, 0, 0 });
+}
+
+void cc0::job::notify_decendants(const char *event)
+{
+	send_decendants(event, payload{ nullptr, 0, 0, 0 });
+}
+
+void cc0::job::notify_group(const char *event, cc0::job::query::results &group)
+{
+	send_group(event, group, payload{ nullptr, 0, 0, 0 });
+}
+
 void cc0::job::notify(const char *event, cc0::job &target)
 {
-	target.get_notified(event, *this);
+	send(event, target, payload{ nullptr, 0, 0, 0 });
+}
+
+void cc0::job::set_event_delivery(cc0::job::delivery_mode mode)
+{
+	m_delivery = mode;
+	for (cc0::job *c = m_child; c != nullptr; c = c->m_sibling) {
+		c->set_event_delivery(mode);
+	}
+}
+
+cc0::job::delivery_mode cc0::job::get_event_delivery( void ) const
+{
+	return m_delivery;
+}
+
+void cc0::job::dispatch_events( void )
+{
+	event_queue batch;
+	batch.swap(g_spare_queue);
+	batch.swap(g_event_queue); // Events sent while dispatching are delivered in the next batch.
+	g_delivered_events = batch.count;
+	if (batch.count == 0) {
+		g_spare_queue.swap(batch);
+		return;
+	}
+
+	uint64_t *order = scratch_new<uint64_t>(batch.count);
+	uint64_t *temp = scratch_new<uint64_t>(batch.count);
+	for (uint64_t i = 0; i < batch.count; ++i) {
+		order[i] = i;
+	}
+	sort_events(batch.events, order, temp, batch.count);
+
+	uint64_t i = 0;
+	while (i < batch.count) {
+		const uint64_t target_id = batch.events[order[i]].target_id;
+		uint64_t end = i;
+		while (end < batch.count && batch.events[order[end]].target_id == target_id) {
+			++end;
+		}
+
+		// Identical events are merged into the last one sent, so that the most recent data is delivered.
+		// Keys only narrow the search. Events whose key collides with a different event are compared against the rest of the group instead.
+		cc0::jobs_internal::search_tree<uint64_t,uint64_t> latest(cc0::jobs_internal::scratch_arena::current());
+		for (uint64_t j = i; j < end; ++j) {
+			const queued_event &e = batch.events[order[j]];
+			if (e.coalesce) {
+				uint64_t *last = latest.add(event_key(e.event, e.sender.get_job() != nullptr ? e.sender.get_job()->get_job_id() : 0) ^ e.payload_type, order[j]);
+				if (same_event(batch.events[*last], e)) {
+					*last = order[j];
+				}
+			}
+		}
+
+		for (; i < end; ++i) {
+			queued_event &e = batch.events[order[i]];
+			cc0::job *sender = e.sender.get_job();
+			cc0::job *target = e.target.get_job();
+			if (sender == nullptr || target == nullptr) {
+				continue;
+			}
+			if (e.coalesce) {
+				const uint64_t *last = latest.get(event_key(e.event, sender->get_job_id()) ^ e.payload_type);
+				if (last != nullptr && *last != order[i]) {
+					if (same_event(batch.events[*last], e)) {
+						continue;
+					}
+					bool superseded = false;
+					for (uint64_t j = i + 1; j < end && !superseded; ++j) {
+						const queued_event &l = batch.events[order[j]];
+						superseded = l.coalesce && same_event(l, e);
+					}
+					if (superseded) {
+						continue;
+					}
+				}
+			}
+			target->get_notified(e.event, *sender, batch.get_payload(e));
+		}
+	}
+	batch.clear();
+	g_spare_queue.swap(batch); // Any storage left in the spare queue by a nested dispatch is freed with the batch.
+}
+
+void cc0::job::end_root_cycle( void )
+{
+	dispatch_events();
+	cc0::jobs_internal::buffered_base::commit_all(); // Event handlers may write to buffered values, so they are committed last.
 }
 
 cc0::job::ref<> cc0::job::get_ref( void )
@@ -911,6 +4108,109 @@ void cc0::job::set_max_tick_per_cycle(uint64_t max_ticks_per_cyle)
 	m_max_ticks_per_cycle = max_ticks_per_cyle > 0 ? max_ticks_per_cyle : 1;
 }
 
+void cc0::job::reserve_memory(uint64_t size, uint64_t count)
+{
+	cc0::jobs_internal::reserve(size, count);
+}
+
+void cc0::job::use_huge_pages(bool enable)
+{
+	cc0::jobs_internal::set_huge_pages(enable);
+}
+
+bool cc0::job::set_memory_node(int64_t node)
+{
+	return cc0::jobs_internal::set_memory_node(node);
+}
+
+int64_t cc0::job::get_memory_node( void )
+{
+	return cc0::jobs_internal::get_memory_node();
+}
+
+void cc0::job::set_allocation_trap(cc0::jobs_internal::allocation_trap trap)
+{
+	g_allocation_trap = trap;
+}
+
+void *cc0::job::scratch_alloc(uint64_t size, uint64_t align)
+{
+	return cc0::jobs_internal::scratch_arena::instance().allocate(size, align);
+}
+
+void cc0::job::set_worker_count(uint64_t count)
+{
+	cc0::jobs_internal::set_worker_count(count);
+}
+
+uint64_t cc0::job::get_worker_count( void )
+{
+	return cc0::jobs_internal::get_worker_count();
+}
+
+uint64_t cc0::job::fork_scenarios(uint64_t count, cc0::jobs_internal::scenario_fn fn, void *context, void *results, uint64_t result_size)
+{
+#if defined(__linux__)
+	if (count == 0 || g_inside_parallel) {
+		return 0; // Forking while the worker threads are busy would copy the tree in the middle of a cycle.
+	}
+	// Each slot holds a flag, set once the result has been written, followed by the result.
+	const uint64_t slot_size = (sizeof(uint64_t) + result_size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+	void *shared = mmap(nullptr, slot_size * count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		return 0;
+	}
+	uint8_t *slots = reinterpret_cast<uint8_t*>(shared);
+	pid_t *pids = new pid_t[count];
+	for (uint64_t i = 0; i < count; ++i) {
+		*reinterpret_cast<uint64_t*>(slots + i * slot_size) = 0;
+	}
+	{
+		// The locks of the library are held while forking, so that no other thread holds them when the process is copied.
+		worker_pool &pool = worker_pool::instance();
+		std::unique_lock<std::mutex> call_lock(pool.call_mutex);
+		std::unique_lock<std::mutex> pool_lock(pool.mutex);
+		std::unique_lock<std::mutex> buffered_lock(g_buffered_mutex);
+		std::unique_lock<std::mutex> components_lock(g_components_mutex);
+		for (uint64_t i = 0; i < count; ++i) {
+			pids[i] = fork();
+			if (pids[i] == 0) {
+				components_lock.unlock();
+				buffered_lock.unlock();
+				pool_lock.unlock();
+				call_lock.unlock();
+				// The worker threads were not copied into this process, so parallel work runs serially on this thread.
+				g_inside_parallel = true;
+				uint8_t *slot = slots + i * slot_size;
+				try {
+					fn(context, *this, i, slot + sizeof(uint64_t));
+				} catch (...) {
+					_exit(1);
+				}
+				*reinterpret_cast<uint64_t*>(slot) = 1;
+				_exit(0); // Skip destructors and exit handlers, which belong to the calling process.
+			}
+		}
+	}
+	uint64_t reported = 0;
+	for (uint64_t i = 0; i < count; ++i) {
+		int status = 0;
+		if (pids[i] > 0 && waitpid(pids[i], &status, 0) == pids[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			const uint8_t *slot = slots + i * slot_size;
+			if (*reinterpret_cast<const uint64_t*>(slot) != 0) {
+				std::memcpy(reinterpret_cast<uint8_t*>(results) + i * result_size, slot + sizeof(uint64_t), result_size);
+				++reported;
+			}
+		}
+	}
+	delete [] pids;
+	munmap(shared, slot_size * count);
+	return reported;
+#else
+	return 0;
+#endif
+}
+
 void cc0::job::run(uint64_t fixed_duration_ns)
 {
 	on_birth();
@@ -922,6 +4222,7 @@ void cc0::job::run(uint64_t fixed_duration_ns)
 		const uint64_t start_ns = fixed_duration_ns == 0 ? std::chrono::high_resolution_clock::now().time_since_epoch().count() : 0;
 
 		cycle(duration_ns);
+		poll_control_socket();
 
 		duration_ns = fixed_duration_ns == 0 ? std::chrono::high_resolution_clock::now().time_since_epoch().count() - start_ns : fixed_duration_ns;
 
@@ -940,6 +4241,9 @@ void cc0::jobs_internal::defer::on_tick(uint64_t)
 {
 	if (get_active_for_ns() >= m_target_time_ns) {
 		notify_parent("defer");
+		if (get_parent() != nullptr) {
+			get_parent()->ignore(*this); // The parent listens to this job only, so the listener would otherwise be left behind for every deferred call.
+		}
 		kill();
 	}
 }
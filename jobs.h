@@ -8,6 +8,8 @@
 #define CC0_JOBS_H_INCLUDED__
 
 #include <cstdint>
+#include <new>
+#include <type_traits>
 
 /// @brief Emits boiler-plate code for creating a new class of job that inherits from another class of job.
 /// @param job_name The name of the new class of job.
@@ -22,6 +24,36 @@
 #define CC0_JOBS_NEW(job_name) \
 	CC0_JOBS_DERIVE(job_name, cc0::job)
 
+/// @brief Returns the address that the current function will return to, used to report the call site of allocations.
+#if defined(__GNUC__) || defined(__clang__)
+	#define CC0_JOBS_CALL_SITE __builtin_return_address(0)
+#else
+	#define CC0_JOBS_CALL_SITE nullptr
+#endif
+
+/// @brief Adds to, or subtracts from, a counter that may be shared between threads ticking in parallel, and returns the new value.
+#if defined(__GNUC__) || defined(__clang__)
+	#define CC0_JOBS_ATOMIC_ADD(counter, value) __atomic_add_fetch(&(counter), (value), __ATOMIC_ACQ_REL)
+	#define CC0_JOBS_ATOMIC_SUB(counter, value) __atomic_sub_fetch(&(counter), (value), __ATOMIC_ACQ_REL)
+#else
+	#define CC0_JOBS_ATOMIC_ADD(counter, value) ((counter) += (value))
+	#define CC0_JOBS_ATOMIC_SUB(counter, value) ((counter) -= (value))
+#endif
+
+/// @brief The largest alignment supported for data sent with events and stored as results, which are copied into memory aligned to this many bytes.
+#define CC0_JOBS_MAX_PAYLOAD_ALIGN 16
+
+/// @brief Sets bits in, reads, or writes a value that may be shared between threads ticking in parallel.
+#if defined(__GNUC__) || defined(__clang__)
+	#define CC0_JOBS_ATOMIC_OR(value, bits)     __atomic_or_fetch(&(value), (bits), __ATOMIC_ACQ_REL)
+	#define CC0_JOBS_ATOMIC_LOAD(value)         __atomic_load_n(&(value), __ATOMIC_ACQUIRE)
+	#define CC0_JOBS_ATOMIC_STORE(value, other) __atomic_store_n(&(value), (other), __ATOMIC_RELEASE)
+#else
+	#define CC0_JOBS_ATOMIC_OR(value, bits)     ((value) |= (bits))
+	#define CC0_JOBS_ATOMIC_LOAD(value)         (value)
+	#define CC0_JOBS_ATOMIC_STORE(value, other) ((value) = (other))
+#endif
+
 namespace cc0
 {
 	class job; // Forward declaration.
@@ -34,6 +66,51 @@ namespace cc0
 		/// @return A new UUID.
 		uint64_t new_uuid( void );
 
+		/// @brief Generates unique IDs for types that do not inherit from rtti.
+		/// @tparam type_t The type.
+		template < typename type_t >
+		struct type_key
+		{
+			/// @brief Returns a unique ID for the type.
+			/// @return A unique ID for the type.
+			static uint64_t id( void );
+		};
+
+		/// @brief Calls the static declare_listeners function of a job class derivative if the class declares one.
+		/// @tparam type_t The job class derivative.
+		/// @note declare_listeners must be public in order to be detected.
+		template < typename type_t >
+		class listener_declarations
+		{
+		private:
+			/// @brief Calls the declare_listeners function.
+			template < typename self_t >
+			static auto declare(int) -> decltype(self_t::declare_listeners(), void());
+
+			/// @brief Does nothing. Selected when the class does not declare a declare_listeners function.
+			template < typename self_t >
+			static void declare(long);
+
+		public:
+			/// @brief Calls the static declare_listeners function of the class if it exists.
+			static void declare( void );
+		};
+
+		/// @brief Determines if the type of a pointer to a tick or tock function refers to something other than the empty default in cc0::job.
+		/// @tparam fn_t The type of the pointer to member function.
+		template < typename fn_t >
+		struct hook
+		{
+			static const bool overridden = true;
+		};
+
+		/// @brief The pointer refers to the empty default in cc0::job.
+		template <>
+		struct hook<void (cc0::job::*)(uint64_t)>
+		{
+			static const bool overridden = false;
+		};
+
 		/// @brief The base class for basic RTTI within the package.
 		class rtti
 		{
@@ -95,6 +172,271 @@ namespace cc0
 			template < typename type_t > struct type_info {};
 		};
 
+		/// @brief The signature of a function that is called when memory is allocated on the heap while a job tree is cycling.
+		/// @param size The number of bytes allocated.
+		/// @param call_site The return address of the allocating function. Null if not available.
+		typedef void (*allocation_trap)(uint64_t size, const void *call_site);
+
+		/// @brief Reports a heap allocation to the allocation trap if the calling thread is currently cycling a job tree.
+		/// @param size The number of bytes allocated.
+		/// @param call_site The return address of the allocating function. Null if not available.
+		void check_allocation(uint64_t size, const void *call_site);
+
+		/// @brief Allocates memory from a pool of fixed-size slots matching the requested size. Sizes too large to pool are allocated on the heap.
+		/// @param size The number of bytes to allocate.
+		/// @return The memory, aligned to at least CC0_JOBS_MAX_PAYLOAD_ALIGN bytes.
+		/// @note Memory returned to a pool is kept by the pool, so allocations are free from heap allocations once the pool has warmed up.
+		/// @note Each thread has its own pools. Memory may be freed by a different thread than the one that allocated it, in which case it is returned to the pools of the freeing thread that belong to the node the memory was allocated for.
+		void *allocate(uint64_t size);
+
+		/// @brief Allocates memory from a pool of fixed-size slots matching the requested size, and reports heap allocations as made from a given call site.
+		/// @param size The number of bytes to allocate.
+		/// @param call_site The address reported to the allocation trap if the heap is used.
+		/// @return The memory, aligned to at least CC0_JOBS_MAX_PAYLOAD_ALIGN bytes.
+		void *allocate(uint64_t size, const void *call_site);
+
+		/// @brief Returns memory to the pool it was allocated from.
+		/// @param p The memory.
+		/// @param size The number of bytes that were requested when the memory was allocated.
+		void deallocate(void *p, uint64_t size);
+
+		/// @brief Ensures that a pool of the calling thread can serve a number of allocations of a given size without allocating heap memory.
+		/// @param size The size of the allocations.
+		/// @param count The number of allocations.
+		void reserve(uint64_t size, uint64_t count);
+
+		/// @brief Determines if pools allocate their memory in huge pages (2 MB), reducing TLB misses when walking large job trees.
+		/// @param enable True to allocate pool memory in huge pages.
+		/// @note Falls back to transparent huge pages, and finally regular heap memory, if huge pages are not available. Only affects memory allocated after the call.
+		void set_huge_pages(bool enable);
+
+		/// @brief Determines if pools allocate their memory in huge pages.
+		/// @return True if pools allocate their memory in huge pages.
+		bool get_huge_pages( void );
+
+		/// @brief Sets the NUMA node that pool memory allocated by the calling thread should be placed on.
+		/// @param node The NUMA node. -1 for no preference.
+		/// @return True if the node is valid.
+		/// @note Each node has its own set of pools. Memory freed by a thread is returned to the pools of the node it was allocated for, so memory never migrates between nodes.
+		/// @note If the memory can not be bound to the node, pools fall back to regular heap memory.
+		bool set_memory_node(int64_t node);
+
+		/// @brief Returns the NUMA node that pool memory allocated by the calling thread is placed on.
+		/// @return The NUMA node. -1 for no preference.
+		int64_t get_memory_node( void );
+
+		/// @brief Locks the component pools, which jobs ticked in parallel may add components to and remove components from.
+		/// @note The lock is not recursive.
+		void lock_components( void );
+
+		/// @brief Unlocks the component pools.
+		void unlock_components( void );
+
+		/// @brief Holds the lock of the component pools while in scope.
+		/// @warning This is an internal class. Do not use in production code as the implementation is subject to change at any time.
+		class component_lock
+		{
+		public:
+			component_lock( void ) { lock_components(); }
+			~component_lock( void ) { unlock_components(); }
+			component_lock(const component_lock&) = delete;
+			component_lock &operator=(const component_lock&) = delete;
+		};
+
+		/// @brief The signature of a function that executes one chunk of a parallel loop.
+		/// @param context User data passed to the parallel loop.
+		/// @param chunk The index of the chunk.
+		/// @param begin The first index of the chunk.
+		/// @param end One past the last index of the chunk.
+		typedef void (*parallel_fn)(void *context, uint64_t chunk, uint64_t begin, uint64_t end);
+
+		/// @brief A function running a what-if scenario in a forked process.
+		/// @param context User data.
+		/// @param self The forked copy of the job.
+		/// @param scenario The index of the scenario.
+		/// @param result Where the result of the scenario is constructed.
+		typedef void (*scenario_fn)(void *context, job &self, uint64_t scenario, void *result);
+
+		/// @brief Returns the number of indices per chunk used by a parallel loop.
+		/// @param count The number of indices in the loop.
+		/// @param grain The requested number of indices per chunk. Zero picks a number that gives every thread several chunks.
+		/// @return The number of indices per chunk.
+		uint64_t parallel_grain(uint64_t count, uint64_t grain);
+
+		/// @brief Executes a loop in chunks on the worker threads and the calling thread. Returns when all chunks have been executed.
+		/// @param begin The first index.
+		/// @param end One past the last index.
+		/// @param grain The requested number of indices per chunk. Zero picks a number automatically.
+		/// @param fn The function executing a chunk.
+		/// @param context User data passed to the function.
+		/// @note Loops started from within a parallel loop run serially on the calling thread.
+		void parallel_range(uint64_t begin, uint64_t end, uint64_t grain, parallel_fn fn, void *context);
+
+		/// @brief Executes a function once per lane, where lane zero runs on the calling thread and every other lane runs on the worker thread with the same index. Returns when all lanes have been executed.
+		/// @param lanes The number of lanes. Lanes beyond the number of worker threads plus one are never executed.
+		/// @param fn The function executing a lane. The chunk index is the lane index, and the range is empty.
+		/// @param context User data passed to the function.
+		/// @note Lanes started from within a parallel loop or another lane run serially on the calling thread.
+		void parallel_lanes(uint64_t lanes, parallel_fn fn, void *context);
+
+		/// @brief Restricts the thread executing a lane to a single CPU core.
+		/// @param lane The lane. Lane zero is the calling thread.
+		/// @param cpu The CPU core. -1 allows all cores.
+		/// @return True if successful. Always false on platforms other than Linux.
+		/// @note Changing the number of worker threads resets the settings of all lanes but lane zero.
+		bool set_lane_cpu(uint64_t lane, int64_t cpu);
+
+		/// @brief Requests a real-time scheduling class (SCHED_FIFO) for the thread executing a lane.
+		/// @param lane The lane. Lane zero is the calling thread.
+		/// @param priority The real-time priority. Zero returns the thread to regular scheduling.
+		/// @return True if successful. Usually requires elevated privileges. Always false on platforms other than Linux.
+		bool set_lane_realtime_priority(uint64_t lane, int64_t priority);
+
+		/// @brief Sets the number of worker threads, not counting the calling thread. Must not be called while a parallel loop is running.
+		/// @param count The number of worker threads.
+		void set_worker_count(uint64_t count);
+
+		/// @brief Returns the number of worker threads, not counting the calling thread. Starts one worker per additional hardware thread if not set.
+		/// @return The number of worker threads.
+		uint64_t get_worker_count( void );
+
+		/// @brief The child whose sub-tree the calling thread is ticking speculatively. Null if the thread is not ticking speculatively.
+		extern thread_local job *speculation_root;
+
+		/// @brief Routes allocations of deriving classes through the pools used by the library.
+		class pooled
+		{
+		public:
+			/// @brief Allocates memory from a pool.
+			/// @param size The number of bytes to allocate.
+			/// @return The memory.
+			static void *operator new(std::size_t size);
+
+			/// @brief Returns memory to a pool.
+			/// @param p The memory.
+			/// @param size The number of bytes to free.
+			static void operator delete(void *p, std::size_t size);
+		};
+
+		/// @brief A bump allocator for temporary memory. Memory is released all at once when the arena is reset.
+		/// @note Each thread has its own arena which is reset at the end of every outermost root cycle on that thread. The arena of a worker thread that ticks children on behalf of a root cycle is not reset until that root cycle ends.
+		class scratch_arena
+		{
+		private:
+			struct block
+			{
+				block    *next;
+				uint64_t  size;
+				uint64_t  used;
+			};
+
+			struct loan
+			{
+				scratch_arena *arena; // The arena of a worker thread that ticked children during the current root cycle.
+				loan          *next;
+			};
+
+		private:
+			block    *m_first;
+			block    *m_current;
+			uint64_t  m_depth;
+			loan     *m_borrowed; // The arenas to release at the end of the outermost root cycle on the thread.
+			uint64_t  m_loans;    // The number of root cycles on other threads that still use memory in the arena. Updated atomically.
+			bool      m_lent;     // Indicates that the arena has been used on behalf of another thread since it was last reset.
+
+		private:
+			/// @brief Allocates a new block and links it in after the current block.
+			/// @param size The minimum number of usable bytes in the block.
+			/// @return The new block.
+			block *new_block(uint64_t size);
+
+		public:
+			/// @brief Initializes an empty arena.
+			scratch_arena( void );
+
+			/// @brief Frees all memory.
+			~scratch_arena( void );
+
+			scratch_arena(const scratch_arena&) = delete;
+			scratch_arena &operator=(const scratch_arena&) = delete;
+
+			/// @brief Allocates memory.
+			/// @param size The number of bytes to allocate.
+			/// @param align The required alignment of the memory. Must be a power of two.
+			/// @return The memory.
+			void *allocate(uint64_t size, uint64_t align);
+
+			/// @brief Marks all memory as free without returning it to the system.
+			void reset( void );
+
+			/// @brief Marks the start of a root cycle.
+			void enter( void );
+
+			/// @brief Marks the end of a root cycle. Resets the arena if this was the outermost root cycle, and releases the arenas borrowed during it.
+			void leave( void );
+
+			/// @brief Marks the arena as being used on behalf of a root cycle on another thread, so that it is not reset until the other thread borrows and then releases it.
+			/// @note Must be called from the thread that owns this arena.
+			void lend( void );
+
+			/// @brief Takes over a lent arena until the end of the outermost root cycle on the calling thread.
+			/// @param arena The arena that was lent.
+			void borrow(scratch_arena &arena);
+
+			/// @brief Determines if the current root cycle is the outermost root cycle on the thread.
+			/// @return True if the current root cycle is the outermost root cycle.
+			bool is_outermost( void ) const;
+
+			/// @brief Returns the arena of the calling thread.
+			/// @return The arena of the calling thread.
+			static scratch_arena &instance( void );
+
+			/// @brief Returns the arena of the calling thread if the thread is currently cycling a job tree.
+			/// @return The arena of the calling thread. Null if the calling thread is not cycling a job tree.
+			static scratch_arena *current( void );
+		};
+
+		/// @brief Links double-buffered values that have been written to into a list, so that they can be committed at the end of the root cycle.
+		class buffered_base
+		{
+		private:
+			buffered_base *m_prev;  // The previous written value.
+			buffered_base *m_next;  // The next written value.
+			bool           m_dirty; // Indicates that the value has been written to since it was last committed.
+
+		private:
+			/// @brief Adds the value to the list of written values.
+			void link( void );
+
+			/// @brief Removes the value from the list of written values.
+			void unlink( void );
+
+		protected:
+			/// @brief Initializes a value that has not been written to.
+			buffered_base( void );
+
+			/// @brief Initializes a copy of a value. If the value has been written to since the last commit, so has the copy, so that the pending write is committed for both.
+			buffered_base(const buffered_base &b);
+
+			/// @brief Removes the value from the list of written values.
+			~buffered_base( void );
+
+			/// @brief Marks the value as written to if the other value has been written to since the last commit, so that the pending write copied with it is committed.
+			/// @param b The other value.
+			/// @return Self.
+			buffered_base &operator=(const buffered_base &b);
+
+			/// @brief Marks the value as written to, so that it is committed at the end of the root cycle.
+			void mark_dirty( void );
+
+			/// @brief Makes the written value visible.
+			virtual void commit( void ) = 0;
+
+		public:
+			/// @brief Commits all values written to since the last commit.
+			static void commit_all( void );
+		};
+
 		/// @brief A binary search tree mapping names of job class derivatives to functions instantiating them.
 		template < typename type_t, typename key_t = const char* >
 		class search_tree
@@ -110,9 +452,21 @@ namespace cc0
 			};
 
 		private:
-			node *m_root;
+			node          *m_root;
+			scratch_arena *m_arena;
 		
 		private:
+			/// @brief Allocates a new node.
+			/// @param hash The hash of the key.
+			/// @param key The key.
+			/// @param value The value.
+			/// @return The new node.
+			node *new_node(uint64_t hash, const key_t &key, const type_t &value);
+
+			/// @brief Frees the memory of a single node.
+			/// @param n The node to free.
+			void delete_node(node *n);
+
 			/// @brief Creates a has from the string.
 			/// @tparam k_t The key type.
 			/// @param s The string.
@@ -150,10 +504,22 @@ namespace cc0
 			template < typename fn_t >
 			void traverse(fn_t &fn, node *n);
 
+			/// @brief Walks the entire tree depth-first order and calls the provided function.
+			/// @tparam fn_t The function to call at each node in the tree, taking the key type and value type as input.
+			/// @param fn The function.
+			/// @param n The node to traverse.
+			template < typename fn_t >
+			void traverse_keys(fn_t &fn, node *n);
+
 		public:
 			/// @brief Initializes search tree.
 			search_tree( void );
 
+			/// @brief Initializes search tree with nodes allocated from an arena.
+			/// @param arena The arena to allocate nodes from. Null allocates nodes on the heap.
+			/// @warning The tree must be destroyed before the arena is reset.
+			explicit search_tree(scratch_arena *arena);
+
 			/// @brief Frees memory in search tree.
 			~search_tree( void );
 
@@ -182,6 +548,12 @@ namespace cc0
 			/// @param fn The function.
 			template < typename fn_t >
 			void traverse(fn_t &fn);
+
+			/// @brief Walks the entire tree depth-first order and calls the provided function.
+			/// @tparam fn_t The function to call at each node in the tree, taking the key type and value type as input.
+			/// @param fn The function.
+			template < typename fn_t >
+			void traverse_keys(fn_t &fn);
 		};
 
 		/// @brief A helper class that will ensure a working in-house RTTI when inheriting from job classes.
@@ -195,6 +567,31 @@ namespace cc0
 		private:
 			static const bool m_registered;
 
+		private:
+			/// @brief Detects if a class overrides on_tick.
+			/// @tparam type_t The class.
+			/// @return True if on_tick is not the empty default in cc0::job.
+			template < typename type_t >
+			static auto overrides_tick(int) -> decltype(&type_t::on_tick, bool());
+
+			/// @brief Selected when on_tick can not be accessed, in which case it is assumed to be overridden.
+			/// @tparam type_t The class.
+			/// @return True.
+			template < typename type_t >
+			static bool overrides_tick(long);
+
+			/// @brief Detects if a class overrides on_tock.
+			/// @tparam type_t The class.
+			/// @return True if on_tock is not the empty default in cc0::job.
+			template < typename type_t >
+			static auto overrides_tock(int) -> decltype(&type_t::on_tock, bool());
+
+			/// @brief Selected when on_tock can not be accessed, in which case it is assumed to be overridden.
+			/// @tparam type_t The class.
+			/// @return True.
+			template < typename type_t >
+			static bool overrides_tock(long);
+
 		protected:
 			/// @brief Returns the self referencing pointer if the provided type ID matches the class ID.
 			/// @param type_id The provided type ID.
@@ -207,6 +604,9 @@ namespace cc0
 			const void *self(uint64_t type_id) const;
 		
 		public:
+			/// @brief Declares the listeners of the class the first time an instance is created, and tells the job which of on_tick and on_tock need to be called.
+			inherit( void );
+
 			/// @brief Returns a unique ID for this specific class.
 			/// @return A unique ID for this specific class.
 			static uint64_t type_id( void );
@@ -230,6 +630,16 @@ namespace cc0
 			/// @brief Determines if the class has been registered so that it can be instantiated via a string.
 			/// @return True if registered. False if there is another class registered under the same name.
 			static bool is_registered( void );
+
+			/// @brief Allocates memory for a job from the pool matching the size of the job.
+			/// @param size The number of bytes to allocate.
+			/// @return The memory.
+			static void *operator new(std::size_t size);
+
+			/// @brief Returns the memory of a job to a pool.
+			/// @param p The memory.
+			/// @param size The number of bytes to free.
+			static void operator delete(void *p, std::size_t size);
 		};
 
 		/// @brief An ease-of-use typedef for the function pointer signature used to instantiate job class derivatives.
@@ -239,24 +649,51 @@ namespace cc0
 	/// @brief A job. Updates itself and its children using custom code that can be inserted via overloading virtual functions within the class.
 	CC0_JOBS_DERIVE(job, jobs_internal::rtti)
 	{
+	public:
+		/// @brief A reference to data sent together with an event.
+		struct payload
+		{
+			const void *data;  // The data. Null if the event carries no data.
+			uint64_t    type;  // The type of the data. See jobs_internal::type_key.
+			uint64_t    size;  // The size of the data in bytes.
+			uint64_t    align; // The alignment of the data in bytes.
+		};
+
 	private:
+		struct completion_waiter;
+
 		/// @brief Shared data used by automatic reference counting.
-		struct shared
+		struct shared : public jobs_internal::pooled
 		{
-			uint64_t watchers;
-			bool     deleted;
+			uint64_t           watchers;    // The number of references to the shared data, including the one held by the job itself. Updated atomically.
+			bool               deleted;     // The job has been destroyed. Updated atomically.
+			bool               completed;   // The job has been killed or deleted.
+			payload            result;      // A copy of the result of the job. The data is null if the job has no result.
+			completion_waiter *waiters;     // The jobs to notify when the job completes.
+
+			/// @brief Initializes the shared data. Watched only by the job itself, not deleted, not completed, no result.
+			shared( void );
+
+			/// @brief Frees the result and the waiters.
+			~shared( void );
+
+			/// @brief Stores a copy of a result.
+			/// @param data The result.
+			void set_result(const payload &data);
 		};
 
 		/// @brief A generic callback for member functions of all derivatives of jobs.
-		class base_callback
+		class base_callback : public jobs_internal::pooled
 		{
 		public:
 			/// @brief Virtual destructor.
 			virtual ~base_callback( void ) {}
 
 			/// @brief Calls the stored callback.
+			/// @param receiver The job receiving the event.
 			/// @param sender The sender.
-			virtual void operator()(job &sender) = 0;
+			/// @param data The data sent with the event.
+			virtual void operator()(job &receiver, job &sender, const payload &data) = 0;
 		};
 
 		/// @brief A generic member function callback.
@@ -269,13 +706,36 @@ namespace cc0
 
 		public:
 			/// @brief Constructor.
-			/// @param self  The object to call the member function from.
+			/// @param self  The object to call the member function from. Null calls the member function from the receiver.
 			/// @param fn The member function.
 			mem_callback(job_t *self, void (job_t::*fn)(job&));
 
 			/// @brief Call the callback.
+			/// @param receiver The job receiving the event.
+			/// @param sender The sender.
+			/// @param data The data sent with the event. Ignored.
+			void operator()(job &receiver, job &sender, const payload &data);
+		};
+
+		/// @brief A member function callback receiving data of a given type sent with the event.
+		template < typename job_t, typename payload_t >
+		class payload_callback : public base_callback
+		{
+		private:
+			job_t *m_self;
+			void (job_t::*m_memfn)(job&, const payload_t&);
+
+		public:
+			/// @brief Constructor.
+			/// @param self  The object to call the member function from. Null calls the member function from the receiver.
+			/// @param fn The member function.
+			payload_callback(job_t *self, void (job_t::*fn)(job&, const payload_t&));
+
+			/// @brief Call the callback.
+			/// @param receiver The job receiving the event.
 			/// @param sender The sender.
-			void operator()(job &sender);
+			/// @param data The data sent with the event. The callback is not called if the data is not of the expected type.
+			void operator()(job &receiver, job &sender, const payload &data);
 		};
 
 		/// @brief A generic function callback.
@@ -290,8 +750,10 @@ namespace cc0
 			fn_callback(void (*fn)(job&));
 
 			/// @brief Call the callback.
+			/// @param receiver The job receiving the event. Ignored.
 			/// @param sender The sender.
-			void operator()(job &sender);
+			/// @param data The data sent with the event. Ignored.
+			void operator()(job &receiver, job &sender, const payload &data);
 		};
 
 		/// @brief A memory managed callback. Automatically deletes on destruction.
@@ -312,13 +774,20 @@ namespace cc0
 			template < typename job_t >
 			void set(job_t *self, void (job_t::*fn)(job&));
 
+			/// @brief Allocates memory for a callback receiving data sent with the event.
+			/// @param fn The callback function.
+			template < typename job_t, typename payload_t >
+			void set(job_t *self, void (job_t::*fn)(job&, const payload_t&));
+
 			/// @brief Allocated memory for a callback.
 			/// @param fn The callback function.
 			void set(void (*fn)(job&));
 
-			/// @brief Calls the stored callback.
+			/// @brief Calls the stored callback. Does nothing if no callback is stored.
+			/// @param receiver The job receiving the event.
 			/// @param sender The sender.
-			void operator()(job &sender);
+			/// @param data The data sent with the event.
+			void operator()(job &receiver, job &sender, const payload &data);
 		};
 
 		/// @brief A search tree with callbacks identified by event name.
@@ -327,7 +796,73 @@ namespace cc0
 		/// @brief A search tree with callback trees identified by sender address.
 		typedef jobs_internal::search_tree<callback_tree, uint64_t> event_tree;
 
+		/// @brief The listeners declared for all instances of a job class derivative.
+		struct type_listeners
+		{
+			callback_tree callbacks; // The callbacks identified by event name.
+			uint64_t      base_id;   // The type ID of the class derived from.
+			uint64_t      bloom;     // A bloom filter of the events declared for the class.
+		};
+
+		/// @brief A search tree with declared listeners identified by type ID.
+		typedef jobs_internal::search_tree<type_listeners, uint64_t> type_tree;
+
+		/// @brief The location of a component attached to a job.
+		struct component_slot
+		{
+			uint64_t   index;
+			void     (*detach)(uint64_t);
+		};
+
+		/// @brief A search tree with component locations identified by component type.
+		typedef jobs_internal::search_tree<component_slot, uint64_t> component_tree;
+
 	public:
+		/// @brief Determines when events sent by a job are delivered to their targets.
+		enum delivery_mode
+		{
+			DELIVER_IMMEDIATELY, // Events are delivered as soon as they are sent.
+			DELIVER_QUEUED,      // Events are queued and delivered, grouped by target, after the root job has finished cycling.
+			DELIVER_COALESCED    // Events are queued like DELIVER_QUEUED, but identical events sent from the same sender to the same target are only delivered once per cycle.
+		};
+
+		/// @brief Determines the order in which a job ticks its children.
+		enum schedule_mode
+		{
+			SCHEDULE_IN_ORDER,    // Children tick in the order they are stored.
+			SCHEDULE_BY_PRIORITY, // Children with higher priority tick first.
+			SCHEDULE_BY_DEADLINE  // Children with earlier deadlines tick first.
+		};
+
+		/// @brief Statistics about a job tree, published to shared memory so that other processes can monitor the tree.
+		/// @sa publish_stats
+		/// @sa read_stats
+		struct stats
+		{
+			/// @brief The number of jobs of a class.
+			struct type_entry
+			{
+				char     name[48]; // The name of the class. Truncated if too long.
+				uint64_t count;    // The number of jobs.
+			};
+
+			enum { MAX_TYPES = 64 }; // The maximum number of classes listed. Jobs of other classes are only included in the totals.
+
+			uint64_t   cycle;            // The number of times the statistics have been published.
+			uint64_t   job_count;        // The number of jobs in the tree, including killed jobs that have not been deleted yet.
+			uint64_t   active_count;     // The number of active jobs.
+			uint64_t   sleeping_count;   // The number of sleeping jobs, including jobs waiting for an event.
+			uint64_t   waiting_count;    // The number of jobs waiting for an event.
+			uint64_t   killed_count;     // The number of killed jobs that have not been deleted yet.
+			uint64_t   queue_depth;      // The number of queued events delivered at the end of the most recent root cycle.
+			uint64_t   cycle_ns_p50;     // The median real time spent cycling the tree, over recent cycles.
+			uint64_t   cycle_ns_p90;     // The 90th percentile of the real time spent cycling the tree, over recent cycles.
+			uint64_t   cycle_ns_p99;     // The 99th percentile of the real time spent cycling the tree, over recent cycles.
+			uint64_t   cycle_ns_max;     // The longest real time spent cycling the tree, over recent cycles.
+			uint64_t   type_count;       // The number of classes listed.
+			type_entry types[MAX_TYPES]; // The number of jobs of each class.
+		};
+
 		/// @brief Safely references a job. Will yield null if the referenced job has been destroyed.
 		/// @tparam job_t The base class of the reference. Defaults to the fundamental job.
 		template < typename job_t = cc0::job >
@@ -395,11 +930,11 @@ namespace cc0
 			void release( void );
 
 			/// @brief Returns the job.
-			/// @return The job. Null if the job has been deleted.
+			/// @return The job. Null if the job has been deleted, or if the job is outside of the sub-tree being ticked speculatively by the calling thread.
 			job_t *get_job( void );
 
 			/// @brief Returns the job.
-			/// @return The job. Null if the job has been deleted.
+			/// @return The job. Null if the job has been deleted, or if the job is outside of the sub-tree being ticked speculatively by the calling thread.
 			const job_t *get_job( void ) const;
 
 			/// @brief Casts the current reference to another.
@@ -409,13 +944,102 @@ namespace cc0
 
 			/// @brief Returns the job.
 			/// @return The job. Null if the job has been deleted.
+			/// @note During a speculative tick, an access outside of the ticking child's sub-tree is recorded as a conflict, but the job is still returned. The access happens before the child is undone and ticked again, so it races with the siblings. Use get_job to stop at the first conflict.
 			job_t *operator->( void );
 
 			/// @brief Returns the job.
 			/// @return The job. Null if the job has been deleted.
+			/// @note During a speculative tick, an access outside of the ticking child's sub-tree is recorded as a conflict, but the job is still returned. The access happens before the child is undone and ticked again, so it races with the siblings. Use get_job to stop at the first conflict.
 			const job_t *operator->( void ) const;
+
+			/// @brief Checks if the referenced job has completed, i.e. has been killed or deleted. Works even after the job has been deleted.
+			/// @return True if the job has completed.
+			bool is_complete( void ) const;
+
+			/// @brief Returns the result of the referenced job. Works even after the job has been deleted.
+			/// @tparam result_t The type of the result.
+			/// @return The result. Null if the job has not completed, or has no result of the given type.
+			template < typename result_t >
+			const result_t *get_result( void ) const;
+		};
+
+		/// @brief Job data with a current and a next value. Reads see the value as it was at the end of the previous root cycle, and writes go to the next value, which becomes current at the end of the root cycle.
+		/// @tparam type_t The type of the value. Must be copy-assignable.
+		/// @note Since jobs never observe partially updated values, the data can be read by any number of jobs ticking in parallel. Each value must only be written by one thread per cycle.
+		template < typename type_t >
+		class buffered : private jobs_internal::buffered_base
+		{
+		private:
+			type_t m_current; // The value visible to reads.
+			type_t m_next;    // The value visible after the end of the root cycle.
+
+		private:
+			/// @brief Makes the next value current.
+			void commit( void );
+
+		public:
+			/// @brief Default-initializes both values.
+			buffered( void );
+
+			/// @brief Initializes both values.
+			/// @param value The value.
+			explicit buffered(const type_t &value);
+
+			/// @brief Returns the current value.
+			/// @return The value as it was at the end of the previous root cycle.
+			const type_t &get( void ) const;
+
+			/// @brief Returns the current value.
+			/// @return The value as it was at the end of the previous root cycle.
+			const type_t &operator*( void ) const;
+
+			/// @brief Returns the current value.
+			/// @return The value as it was at the end of the previous root cycle.
+			const type_t *operator->( void ) const;
+
+			/// @brief Sets the next value.
+			/// @param value The value.
+			void set(const type_t &value);
+
+			/// @brief Returns the next value for modification.
+			/// @return The next value. Starts out as the latest value written, or the current value if the value has not been written to since the last commit.
+			type_t &next( void );
+
+			/// @brief Returns the next value.
+			/// @return The next value.
+			const type_t &peek_next( void ) const;
+		};
+
+	private:
+		struct history;         // Forward declaration.
+		struct stats_publisher; // Forward declaration.
+		struct control_socket;  // Forward declaration.
+		struct cpu_quota;       // Forward declaration.
+		struct extension;       // Forward declaration.
+
+		/// @brief A job waiting for another job to complete.
+		struct completion_waiter : public jobs_internal::pooled
+		{
+			ref<job>           waiter; // The waiting job.
+			completion_waiter *next;   // The next waiting job.
+		};
+
+		/// @brief A sibling that a job must tick after.
+		struct dependency : public jobs_internal::pooled
+		{
+			ref<job>    target; // The sibling.
+			dependency *next;   // The next sibling.
+		};
+
+		/// @brief A region of user data that is saved before a speculative tick and restored if the tick is undone.
+		struct state_region : public jobs_internal::pooled
+		{
+			void         *data; // The data.
+			uint64_t      size; // The size of the data in bytes.
+			state_region *next; // The next region.
 		};
 
+	public:
 		/// @brief A search query containing a number of filters executed in sequence on the subject's children.
 		/// @note Filters are alternative, meaning if a job fits any of the filters, then the job is selected.
 		class query
@@ -424,7 +1048,7 @@ namespace cc0
 			class results;
 			
 			/// @brief A single result from a search query.
-			class result
+			class result : public jobs_internal::pooled
 			{
 				friend class results;
 
@@ -578,6 +1202,75 @@ namespace cc0
 			virtual bool operator()(const job &j) const;
 		};
 
+		/// @brief A dense pool containing all components of a single type, stored contiguously so that systems can process them in bulk.
+		/// @tparam component_t The type of the component. Must be default constructible and move assignable.
+		/// @note Removing a component moves the last component in the pool into the freed location, so the order of components is not stable.
+		/// @note Jobs ticked in parallel may add and remove components, as all pools share one lock. Iterating a pool is not guarded by the lock, so do not iterate a pool while jobs ticked in parallel add or remove components of the same type.
+		template < typename component_t >
+		class components
+		{
+			friend class job;
+
+		private:
+			component_t  *m_data;
+			job         **m_owners;
+			uint64_t      m_count;
+			uint64_t      m_capacity;
+
+		private:
+			/// @brief Initializes an empty pool.
+			components( void );
+
+			/// @brief Deletes memory.
+			~components( void );
+
+			components(const components&) = delete;
+			components &operator=(const components&) = delete;
+
+			/// @brief Returns the one pool for the component type.
+			/// @return The one pool for the component type.
+			/// @note The pool is never destroyed.
+			static components &instance( void );
+
+			/// @brief Allocates a new component at the end of the pool.
+			/// @param owner The job the component is attached to.
+			/// @return The index of the new component.
+			uint64_t add(job &owner);
+
+			/// @brief Removes a component by moving the last component into its location.
+			/// @param index The index of the component to remove.
+			void remove(uint64_t index);
+
+			/// @brief Removes a component from the one pool for the component type.
+			/// @param index The index of the component to remove.
+			static void detach(uint64_t index);
+
+		public:
+			/// @brief Returns the number of components in the pool.
+			/// @return The number of components in the pool.
+			uint64_t count( void ) const;
+
+			/// @brief Returns the component at the given index.
+			/// @param i The index.
+			/// @return The component at the given index.
+			component_t &operator[](uint64_t i);
+
+			/// @brief Returns the component at the given index.
+			/// @param i The index.
+			/// @return The component at the given index.
+			const component_t &operator[](uint64_t i) const;
+
+			/// @brief Returns the job that the component at the given index is attached to.
+			/// @param i The index.
+			/// @return The job that the component at the given index is attached to.
+			job *get_owner(uint64_t i);
+
+			/// @brief Returns the job that the component at the given index is attached to.
+			/// @param i The index.
+			/// @return The job that the component at the given index is attached to.
+			const job *get_owner(uint64_t i) const;
+		};
+
 	private:
 		static jobs_internal::search_tree<jobs_internal::instance_fn> m_products;
 
@@ -598,7 +1291,31 @@ namespace cc0
 		uint64_t                              m_accumulated_duration_ns; // The accumulated time between job runs.
 		uint64_t                              m_max_ticks_per_cycle;     // Limits the numer of ticks that are allowed to be performed each cycle for this job.
 		event_tree                            m_event_callbacks;         // Holds the callbacks to be triggered when a particular event is sent to the job.
+		component_tree                        m_components;              // Holds the locations of the components attached to the job.
 		shared                               *m_shared;                  // Holds information about references to this job.
+		extension                            *m_extension;               // Holds the state of features that most jobs do not use. Allocated the first time such a feature is used. Null until then.
+		uint64_t                              m_listen_bloom;            // A bloom filter of the events the job listens to.
+		uint64_t                              m_subtree_bloom;           // A bloom filter of the events the job and its decendants listen to. May contain stale events. Updated atomically.
+		int64_t                               m_priority;                // The priority of the job relative to its siblings.
+		uint64_t                              m_deferrals;               // The number of consecutive cycles the job has been deferred because its parent ran out of child budget.
+		uint64_t                              m_dependency_level;        // The length of the longest chain of dependencies leading up to the job.
+		uint64_t                              m_cost_ns;                 // A moving average of the real time spent cycling the job when its parent ticks children in parallel.
+		uint64_t                              m_lane;                    // The lane the job is cycled on when its parent ticks children in parallel.
+		uint64_t                              m_object_size;             // The size of the most derived class of the job in bytes.
+		uint64_t                              m_object_align;            // The alignment of the most derived class of the job in bytes.
+		schedule_mode                         m_schedule;                // Determines the order in which children tick.
+		delivery_mode                         m_delivery;                // Determines when events sent by the job are delivered.
+		bool                                  m_bloom_dirty;             // Indicates that the sub-tree bloom filter may contain stale events. Updated atomically.
+		bool                                  m_schedule_dirty;          // Indicates that the children need to be sorted before ticking.
+		bool                                  m_parallel_children;       // Indicates that the children are ticked in parallel.
+		bool                                  m_speculative_children;    // Indicates that the children are ticked in parallel without requiring them to stay within their own sub-trees.
+		bool                                  m_speculative;             // Indicates that the job was added during a speculative tick that has not been committed yet.
+		bool                                  m_kill_pending;            // Indicates that the job was killed during a speculative tick, and is killed once the tick is committed.
+		bool                                  m_paused;                  // Indicates that the job and its sub-tree are not cycled, while elapsed time accumulates.
+		bool                                  m_frozen;                  // Indicates that the job and its sub-tree are not cycled, and that elapsed time is discarded.
+		bool                                  m_tick_hook;               // Indicates that on_tick is overridden and needs to be called.
+		bool                                  m_tock_hook;               // Indicates that on_tock is overridden and needs to be called.
+		bool                                  m_state_registered;        // Indicates that all data added by the classes derived from cc0::job is registered, so that the job can be undone.
 		bool                                  m_enabled;                 // Indicates that the job is allowed to run.
 		bool                                  m_kill;                    // Indicates that the user has marked the job for termination.
 		bool                                  m_waiting;                 // Indicates that the job is being attempted to run despite the provided input time duration is less than the allowed duration minimum.
@@ -608,6 +1325,10 @@ namespace cc0
 		/// @brief  Tells the shared object that the referenced object has been deleted.
 		void set_deleted( void );
 
+		/// @brief Returns the state of the features that most jobs do not use, allocating it on first use.
+		/// @return The state of the features that most jobs do not use.
+		extension &extend( void );
+
 		/// @brief Adds a job as a sibling. If specified sibling location is null, then the job is added there, otherwise it recursively traverses to the next sibling location.
 		/// @param loc The sibling location.
 		/// @param p The job to add as a sibling.
@@ -625,14 +1346,261 @@ namespace cc0
 		/// @param child The current child in the list.
 		void delete_killed_children(job *&child);
 
+		/// @brief Hints to the processor that a job is about to be accessed.
+		/// @param j The job. May be null.
+		static void prefetch(const job *j);
+
+		/// @brief Checks if a job should tick before another under a given schedule.
+		/// @param a The first job.
+		/// @param b The second job.
+		/// @param mode The schedule.
+		/// @return True if a should tick before b.
+		static bool precedes(const job *a, const job *b, schedule_mode mode);
+
+		/// @brief Sorts a list of siblings. The sort is stable.
+		/// @param list The first sibling in the list.
+		/// @param mode The schedule.
+		/// @return The first sibling in the sorted list.
+		static job *sort_siblings(job *list, schedule_mode mode);
+
+		/// @brief Lets the parent know that its children need to be sorted before ticking.
+		void mark_schedule_dirty( void );
+
+		/// @brief Computes the dependency level of a child. Dependencies forming a cycle are ignored.
+		/// @param child The child.
+		/// @return The dependency level.
+		uint64_t update_dependency_level(job *child);
+
+		/// @brief Computes the dependency levels of all children and removes dependencies on deleted jobs.
+		/// @return True if any child depends on a sibling.
+		bool update_dependency_levels( void );
+
+		/// @brief Checks if the children need to be redistributed among lanes, either because a child has no lane or because the load is uneven.
+		/// @param lanes The number of lanes.
+		/// @return True if the children need to be redistributed.
+		bool needs_rebalance(uint64_t lanes) const;
+
+		/// @brief Distributes the children among lanes so that the total cost of each lane is roughly even. Children stay in their current lane if it does not make the load uneven.
+		/// @param lanes The number of lanes.
+		void rebalance(uint64_t lanes);
+
+		/// @brief Cycles the children assigned to a lane. Called from the worker pool.
+		/// @param context The children to cycle.
+		/// @param lane The lane.
+		static void tick_lane(void *context, uint64_t lane, uint64_t, uint64_t);
+
+		/// @brief Ticks children on the worker threads.
+		/// @param duration_ns The time elapsed.
+		void tick_children_in_parallel(uint64_t duration_ns);
+
+		/// @brief Checks if a job is within the sub-tree the calling thread is ticking speculatively, and records a conflict if not.
+		/// @param target The job.
+		/// @return True if the job may be accessed.
+		static bool track_access(const job *target);
+
+		/// @brief Checks if a job is within the sub-tree the calling thread is ticking speculatively, and records that the structure of the sub-tree changes.
+		/// @param target The job that is killed, or that a child is added to.
+		/// @return True if the job may be changed.
+		static bool track_change(const job *target);
+
+		/// @brief Returns the number of bytes needed to save the state of the job.
+		/// @return The number of bytes.
+		uint64_t get_state_size( void ) const;
+
+		/// @brief Saves the state of the library and the registered user data.
+		/// @param state Where the state is saved. Must hold at least get_state_size bytes, and be aligned to 64 bits.
+		void save_state(uint8_t *state) const;
+
+		/// @brief Restores the state saved via save_state.
+		/// @param state The saved state.
+		void restore_state(const uint8_t *state);
+
+		/// @brief Returns the number of bytes occupied by a saved state.
+		/// @param state The saved state.
+		/// @return The number of bytes.
+		static uint64_t get_saved_state_size(const uint8_t *state);
+
+		/// @brief Determines if the data added by the classes derived from cc0::job is covered by registered state, and stores the result.
+		void update_state_registered( void );
+
+		/// @brief Saves the state of the job and its decendants before a speculative tick.
+		/// @return True if the whole state of the sub-tree is registered, so that the tick can be undone.
+		bool save_subtree( void );
+
+		/// @brief Restores the state of the job and its decendants after a speculative tick, and deletes the jobs added during the tick.
+		void undo_subtree( void );
+
+		/// @brief Keeps the jobs added, and kills the jobs killed, during a speculative tick.
+		void commit_subtree( void );
+
+		/// @brief Returns the history that the job is part of.
+		/// @return The history of the closest ancestor, or the job itself, that records history. Null if none does.
+		history *find_history( void );
+
+		/// @brief Updates the cached history of the job and its sub-tree after a history was started or stopped.
+		/// @param inherited The history that the parent of the job is part of.
+		void set_recorder(history *inherited);
+
+		/// @brief Records in the history that the job was added to its parent.
+		void record_spawn( void );
+
+		/// @brief Moves a killed job to the graveyard of the history, instead of deleting it, so that it can be revived when rewinding.
+		/// @param next The sibling following the job.
+		/// @return True if the job was moved to the graveyard. False if the job is not part of a history, and should be deleted.
+		bool record_burial(job *next);
+
 		/// @brief Ticks children.
 		/// @param duration_ns The time elapsed.
 		void tick_children(uint64_t duration_ns);
 
+		/// @brief Returns the bloom filter bits of an event.
+		/// @param event The event.
+		/// @return The bloom filter bits.
+		static uint64_t event_bloom(const char *event);
+
+		/// @brief Adds an event to the bloom filters of the job and its ancestors.
+		/// @param bloom The bloom filter bits of the event.
+		void add_listen_bloom(uint64_t bloom);
+
+		/// @brief Adds events to the sub-tree bloom filters of the job and its ancestors.
+		/// @param bloom The bloom filter bits of the events.
+		void add_subtree_bloom(uint64_t bloom);
+
+		/// @brief Rebuilds the bloom filter of the events the job listens to after events have been ignored.
+		void rebuild_listen_bloom( void );
+
+		/// @brief Returns the listeners declared for a job class derivative.
+		/// @param type_id The type ID of the class.
+		/// @param create Creates the listeners if they do not exist.
+		/// @return The listeners. Null if they do not exist and create is false.
+		static type_listeners *get_type_listeners(uint64_t type_id, bool create);
+
+		/// @brief Returns the callback declared for an event by a job class derivative or any of the classes it derives from.
+		/// @param type_id The type ID of the class.
+		/// @param event The event.
+		/// @return The callback declared by the most derived class. Null if no class declares the event.
+		static callback *get_type_callback(uint64_t type_id, const char *event);
+
+		/// @brief Returns the bloom filter of the events declared by a job class derivative and all of the classes it derives from.
+		/// @param type_id The type ID of the class.
+		/// @return The bloom filter bits.
+		static uint64_t get_type_bloom(uint64_t type_id);
+
+		/// @brief Marks the sub-tree bloom filters of the job and its ancestors as potentially containing stale events.
+		void mark_bloom_dirty( void );
+
+		/// @brief Removes stale events from the sub-tree bloom filter.
+		void update_subtree_bloom( void );
+
+		/// @brief Notifies the job and its decendants that listen to an event.
+		/// @param event The event string.
+		/// @param bloom The bloom filter bits of the event.
+		/// @param sender The sender.
+		/// @param data The data sent with the event.
+		void broadcast(const char *event, uint64_t bloom, job &sender, const payload &data);
+
+		/// @brief Finishes the outermost root cycle on the calling thread.
+		static void end_root_cycle( void );
+
+		/// @brief Determines if the job and its sub-tree sit out a cycle because the job is frozen, paused, waiting for an event or over its processor time quota, and accounts for the elapsed time accordingly.
+		/// @param duration_ns The time elapsed.
+		/// @return True if the cycle is skipped.
+		bool skip_cycle(uint64_t duration_ns);
+
 		/// @brief Pass an event to this job from a sender.
 		/// @param event The event string.
 		/// @param sender The sender.
-		void get_notified(const char *event, job &sender);
+		/// @param data The data sent with the event.
+		void get_notified(const char *event, job &sender, const payload &data);
+
+		/// @brief Executes a chunk of a parallel_for.
+		/// @tparam fn_t The type of the function.
+		/// @param context The function.
+		/// @param chunk The index of the chunk.
+		/// @param begin The first index of the chunk.
+		/// @param end One past the last index of the chunk.
+		template < typename fn_t >
+		static void parallel_for_chunk(void *context, uint64_t chunk, uint64_t begin, uint64_t end);
+
+		/// @brief Executes a chunk of a parallel_reduce.
+		/// @tparam reduce_t The type holding the functions and the partial results.
+		/// @param context The functions and the partial results.
+		/// @param chunk The index of the chunk.
+		/// @param begin The first index of the chunk.
+		/// @param end One past the last index of the chunk.
+		template < typename reduce_t >
+		static void parallel_reduce_chunk(void *context, uint64_t chunk, uint64_t begin, uint64_t end);
+
+		/// @brief Runs a what-if scenario and constructs its result.
+		/// @tparam result_t The type of the result.
+		/// @tparam fn_t The type of the function.
+		/// @param context The function.
+		/// @param self The forked copy of the job.
+		/// @param scenario The index of the scenario.
+		/// @param result Where the result is constructed.
+		template < typename result_t, typename fn_t >
+		static void run_scenario(void *context, job &self, uint64_t scenario, void *result);
+
+		/// @brief Forks the process once per scenario and collects the results via shared memory.
+		/// @param count The number of scenarios.
+		/// @param fn The function running a scenario.
+		/// @param context User data passed to the function.
+		/// @param results An array of results, one per scenario.
+		/// @param result_size The size of a result in bytes.
+		/// @return The number of scenarios that reported a result.
+		uint64_t fork_scenarios(uint64_t count, jobs_internal::scenario_fn fn, void *context, void *results, uint64_t result_size);
+
+		/// @brief Returns the event used to notify waiting jobs that a job has completed.
+		/// @return The event.
+		static const char *completion_event( void );
+
+		/// @brief Adds a job to the list of jobs to notify when this job completes. Does nothing if the job is already in the list.
+		/// @param waiter The waiting job.
+		void add_completion_waiter(job &waiter);
+
+		/// @brief Marks the job as completed and notifies the waiting jobs.
+		void complete( void );
+
+		/// @brief Creates a reference to data sent with an event.
+		/// @tparam payload_t The type of the data. Must be trivially copyable, and aligned to at most CC0_JOBS_MAX_PAYLOAD_ALIGN bytes.
+		/// @param data The data.
+		/// @return The reference.
+		template < typename payload_t >
+		static payload make_payload(const payload_t &data);
+
+		/// @brief Sends an event to a target, either immediately or via the event queue.
+		/// @param event The event string.
+		/// @param target The target of the event.
+		/// @param data The data sent with the event.
+		void send(const char *event, job &target, const payload &data);
+
+		/// @brief Sends an event to the parent.
+		/// @param event The event string.
+		/// @param data The data sent with the event.
+		void send_parent(const char *event, const payload &data);
+
+		/// @brief Sends an event to all children.
+		/// @param event The event string.
+		/// @param data The data sent with the event.
+		void send_children(const char *event, const payload &data);
+
+		/// @brief Sends an event to all decendants that listen to it.
+		/// @param event The event string.
+		/// @param data The data sent with the event.
+		void send_decendants(const char *event, const payload &data);
+
+		/// @brief Sends an event to all entries in a group.
+		/// @param event The event string.
+		/// @param group The group.
+		/// @param data The data sent with the event.
+		void send_group(const char *event, job::query::results &group, const payload &data);
+
+		/// @brief Performs the ticks that the accumulated duration allows for.
+		/// @param duration_ns The time elapsed.
+		void perform_ticks(uint64_t duration_ns);
+
+		/// @brief Removes all components attached to the job from their pools.
+		void detach_components( void );
 
 		/// @brief Scales a time.
 		/// @param time The time to scale.
@@ -688,6 +1656,53 @@ namespace cc0
 		/// @brief Disables sleep.
 		void wake( void );
 
+		/// @brief Lets the job, and its sub-tree, sleep until it is notified of an event. The job is not ticked at all while waiting.
+		/// @param event The event to wait for. The string must remain valid until the job wakes.
+		/// @param timeout_ns The maximum amount of time to wait for the event.
+		/// @note Any callback listening to the event is called when the job wakes.
+		/// @note Only ticking is skipped. Other events sent to the job or its sub-tree while waiting are still delivered to their callbacks.
+		void sleep_until_event(const char *event, uint64_t timeout_ns = UINT64_MAX);
+
+		/// @brief Lets the job, and its sub-tree, sleep until it is notified of an event originating from a specified sender. The job is not ticked at all while waiting.
+		/// @param event The event to wait for. The string must remain valid until the job wakes.
+		/// @param sender The origin of the event.
+		/// @param timeout_ns The maximum amount of time to wait for the event.
+		/// @note Any callback listening to the event is called when the job wakes.
+		/// @note Only ticking is skipped. Other events sent to the job or its sub-tree while waiting are still delivered to their callbacks.
+		void sleep_until_event(const char *event, const cc0::job &sender, uint64_t timeout_ns = UINT64_MAX);
+
+		/// @brief Lets the job, and its sub-tree, sleep until another job completes, i.e. is killed or deleted. The job is not ticked at all while waiting.
+		/// @param target The job to wait for. Does nothing if the job has already completed.
+		/// @param timeout_ns The maximum amount of time to wait.
+		/// @note Only ticking is skipped. Events sent to the job or its sub-tree while waiting are still delivered to their callbacks.
+		void sleep_until_complete(cc0::job &target, uint64_t timeout_ns = UINT64_MAX);
+
+		/// @brief Calls a member function once when another job completes, i.e. is killed or deleted.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @param target The job to wait for. The callback is called immediately if the job has already completed.
+		/// @param callback The member function to call, taking the completed job as input.
+		/// @note Only one callback can be registered per target job. Registering another replaces the previous.
+		template < typename job_t >
+		void when_complete(cc0::job &target, void (job_t::*callback)(job&));
+
+		/// @brief Calls a member function once when another job completes, i.e. is killed or deleted, with the result of the job.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @tparam result_t The type of the result. The callback is not called if the job has no result of the given type.
+		/// @param target The job to wait for. The callback is called immediately if the job has already completed.
+		/// @param callback The member function to call, taking the completed job and its result as input.
+		template < typename job_t, typename result_t >
+		void when_complete(cc0::job &target, void (job_t::*callback)(job&, const result_t&));
+
+		/// @brief Sets the result of the job, passed to waiting jobs when the job completes.
+		/// @tparam result_t The type of the result. Must be trivially copyable.
+		/// @param result The result.
+		template < typename result_t >
+		void set_result(const result_t &result);
+
+		/// @brief Checks if the job has completed, i.e. has been killed or deleted.
+		/// @return True if the job has completed.
+		bool is_complete( void ) const;
+
 		/// @brief Adds an event for the job to listen and respond to.
 		/// @tparam job_t The sub-class the callback method is declared in.
 		/// @param event The event to listen to.
@@ -703,17 +1718,51 @@ namespace cc0
 		template < typename job_t >
 		void listen(const char *event, const cc0::job &sender, void (job_t::*callback)(job&));
 
-		/// @brief Stops listening to the named event.
-		/// @param event The event to stop listening to.
-		void ignore(const char *event);
+		/// @brief Adds an event carrying data for the job to listen and respond to.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @tparam payload_t The type of the data carried by the event. Events carrying data of any other type are not passed to the callback.
+		/// @param event The event to listen to.
+		/// @param callback The member function to call when this job receives the event.
+		template < typename job_t, typename payload_t >
+		void listen(const char *event, void (job_t::*callback)(job&, const payload_t&));
 
-		/// @brief Ignores an even from a sender.
-		/// @param event The event.
+		/// @brief Adds an event carrying data for the job to listen and respond to if the event originates from a specified sender.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @tparam payload_t The type of the data carried by the event. Events carrying data of any other type are not passed to the callback.
+		/// @param event The event to listen to.
 		/// @param sender The origin of the event.
-		void ignore(const char *event, const cc0::job &sender);
+		/// @param callback The member function to call when this job receives the event.
+		template < typename job_t, typename payload_t >
+		void listen(const char *event, const cc0::job &sender, void (job_t::*callback)(job&, const payload_t&));
 
-		/// @brief Ignores all events originating from the specified sender.
-		/// @param sender The origin of events.
+		/// @brief Adds an event for all instances of a job class derivative to listen and respond to. Stored once for the class rather than once per instance.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @param event The event to listen to.
+		/// @param callback The member function to call when an instance receives the event.
+		/// @note Listeners added via listen take precedence over declared listeners. Declared listeners are inherited by derived classes.
+		/// @note Intended to be called from a public static declare_listeners function in the class, which is called once before the first instance of the class is created.
+		template < typename job_t >
+		static void declare_listener(const char *event, void (job_t::*callback)(job&));
+
+		/// @brief Adds an event carrying data for all instances of a job class derivative to listen and respond to. Stored once for the class rather than once per instance.
+		/// @tparam job_t The sub-class the callback method is declared in.
+		/// @tparam payload_t The type of the data carried by the event. Events carrying data of any other type are not passed to the callback.
+		/// @param event The event to listen to.
+		/// @param callback The member function to call when an instance receives the event.
+		template < typename job_t, typename payload_t >
+		static void declare_listener(const char *event, void (job_t::*callback)(job&, const payload_t&));
+
+		/// @brief Stops listening to the named event.
+		/// @param event The event to stop listening to.
+		void ignore(const char *event);
+
+		/// @brief Ignores an even from a sender.
+		/// @param event The event.
+		/// @param sender The origin of the event.
+		void ignore(const char *event, const cc0::job &sender);
+
+		/// @brief Ignores all events originating from the specified sender.
+		/// @param sender The origin of events.
 		void ignore(const cc0::job &sender);
 
 		/// @brief Adds a child to the job's list of children.
@@ -729,12 +1778,66 @@ namespace cc0
 		/// @sa CC0_JOBS_DERIVE
 		job *add_child(const char *type_name);
 
+		/// @brief Attaches a component to the job. The component is stored in a pool together with all other components of the same type.
+		/// @tparam component_t The type of the component.
+		/// @return A pointer to the component. If the job already has a component of the given type, the existing component is returned. Null if the job has been killed.
+		/// @note The returned pointer is invalidated when components of the same type are added or removed, including by jobs ticked in parallel.
+		template < typename component_t >
+		component_t *add_component( void );
+
+		/// @brief Returns a component attached to the job.
+		/// @tparam component_t The type of the component.
+		/// @return A pointer to the component. Null if the job has no component of the given type.
+		/// @note The returned pointer is invalidated when components of the same type are added or removed, including by jobs ticked in parallel.
+		template < typename component_t >
+		component_t *get_component( void );
+
+		/// @brief Returns a component attached to the job.
+		/// @tparam component_t The type of the component.
+		/// @return A pointer to the component. Null if the job has no component of the given type.
+		/// @note The returned pointer is invalidated when components of the same type are added or removed, including by jobs ticked in parallel.
+		template < typename component_t >
+		const component_t *get_component( void ) const;
+
+		/// @brief Detaches a component from the job. Does nothing if the job has no component of the given type.
+		/// @tparam component_t The type of the component.
+		template < typename component_t >
+		void remove_component( void );
+
+		/// @brief Returns the pool containing all components of a given type, for all jobs.
+		/// @tparam component_t The type of the component.
+		/// @return The pool containing all components of a given type.
+		template < typename component_t >
+		static components<component_t> &get_components( void );
+
 		/// @brief Enables the job, allowing it to tick and call the death function.
 		void enable( void );
 
 		/// @brief Disables the job, disabling ticking and death function.
 		void disable( void );
 
+		/// @brief Stops cycling the job and its sub-tree without changing the flags of any descendant. Elapsed time accumulates, and is caught up on once the job is resumed.
+		/// @note Only ticking stops. Jobs in the sub-tree still receive events sent to them, and run their event callbacks, while paused.
+		void pause( void );
+
+		/// @brief Resumes cycling the job and its sub-tree after it was paused.
+		void resume( void );
+
+		/// @brief Checks if the job has been paused.
+		/// @return True if the job is paused.
+		bool is_paused( void ) const;
+
+		/// @brief Stops time for the job and its sub-tree. The sub-tree is not cycled, and elapsed time, including sleeps and timeouts, stands still until the job is thawed.
+		/// @note Only ticking stops. Jobs in the sub-tree still receive events sent to them, and run their event callbacks, while frozen.
+		void freeze( void );
+
+		/// @brief Lets time pass for the job and its sub-tree again after it was frozen.
+		void thaw( void );
+
+		/// @brief Checks if time has been frozen for the job.
+		/// @return True if the job is frozen.
+		bool is_frozen( void ) const;
+
 		/// @brief Checks if the job has been killed.
 		/// @return True if the job has been killed.
 		bool is_killed( void ) const;
@@ -760,6 +1863,11 @@ namespace cc0
 		/// @brief Checks if the job is awake.
 		/// @return True if the job is awake.
 		bool is_awake( void ) const;
+
+		/// @brief Checks if the job is sleeping until it is notified of an event.
+		/// @return True if the job is waiting for an event.
+		/// @note A waiting job is not ticked, but unlike a sleeping job it remains active, so it handles the events it receives while waiting.
+		bool is_waiting_for_event( void ) const;
 		
 		/// @brief Checks if the job is currently active.
 		/// @return True if the job is neither killed, disabled, or asleep.
@@ -791,6 +1899,11 @@ namespace cc0
 		/// @note Nothing will happen if the job is not active.
 		void notify_children(const char *event);
 
+		/// @brief Notify all decendants of an event. Sub-trees without any job listening to the event are skipped.
+		/// @param event The event string.
+		/// @note Nothing will happen if the job is not active.
+		void notify_decendants(const char *event);
+
 		/// @brief Notify all entries in a group of an event.
 		/// @param event The event string.
 		/// @param group The group to be notified.
@@ -803,6 +1916,220 @@ namespace cc0
 		/// @note Nothing will happen if the job is not active. 
 		void notify(const char *event, job &target);
 
+		/// @brief Notifies the parent of an event carrying data.
+		/// @tparam payload_t The type of the data.
+		/// @param event The event string.
+		/// @param data The data. Copied if the event is queued, so the type must be trivially copyable.
+		/// @note Nothing will happen if the job is not active.
+		template < typename payload_t >
+		void notify_parent(const char *event, const payload_t &data);
+
+		/// @brief Notify all children of an event carrying data.
+		/// @tparam payload_t The type of the data.
+		/// @param event The event string.
+		/// @param data The data. Copied if the event is queued, so the type must be trivially copyable.
+		/// @note Nothing will happen if the job is not active.
+		template < typename payload_t >
+		void notify_children(const char *event, const payload_t &data);
+
+		/// @brief Notify all decendants of an event carrying data. Sub-trees without any job listening to the event are skipped.
+		/// @tparam payload_t The type of the data.
+		/// @param event The event string.
+		/// @param data The data. Copied if the event is queued, so the type must be trivially copyable.
+		/// @note Nothing will happen if the job is not active.
+		template < typename payload_t >
+		void notify_decendants(const char *event, const payload_t &data);
+
+		/// @brief Notify all entries in a group of an event carrying data.
+		/// @tparam payload_t The type of the data.
+		/// @param event The event string.
+		/// @param group The group to be notified.
+		/// @param data The data. Copied if the event is queued, so the type must be trivially copyable.
+		/// @note Nothing will happen if the job is not active.
+		template < typename payload_t >
+		void notify_group(const char *event, job::query::results &group, const payload_t &data);
+
+		/// @brief Notify the target job of an event carrying data.
+		/// @tparam payload_t The type of the data.
+		/// @param event The event string.
+		/// @param target The target of the event.
+		/// @param data The data. Copied if the event is queued, so the type must be trivially copyable.
+		template < typename payload_t >
+		void notify(const char *event, job &target, const payload_t &data);
+
+		/// @brief Sets when events sent by this job and all of its current decendants are delivered. Children added later inherit the mode of their parent.
+		/// @param mode The delivery mode.
+		/// @note Queued events refer to the event string rather than copying it, so the string must remain valid until the event has been delivered.
+		void set_event_delivery(delivery_mode mode);
+
+		/// @brief Returns when events sent by this job are delivered.
+		/// @return The delivery mode.
+		delivery_mode get_event_delivery( void ) const;
+
+		/// @brief Sets the order in which the children of the job tick.
+		/// @param mode The schedule.
+		/// @note Children are sorted in place, so the order of children observed via tree navigation changes accordingly.
+		void set_child_schedule(schedule_mode mode);
+
+		/// @brief Returns the order in which the children of the job tick.
+		/// @return The schedule.
+		schedule_mode get_child_schedule( void ) const;
+
+		/// @brief Sets the priority of the job relative to its siblings. Used when the parent schedules children by priority.
+		/// @param priority The priority. Higher priorities tick first. Defaults to zero.
+		void set_priority(int64_t priority);
+
+		/// @brief Determines if the children of the job tick in parallel on the worker threads. Each child's sub-tree is ticked on a single thread, and children are moved between threads at cycle boundaries to even out the load.
+		/// @param enable True to tick children in parallel.
+		/// @note Children ticking in parallel must not access the sub-trees of their siblings, and should use queued event delivery for events sent outside of their own sub-trees. Dependencies between children are respected, but the child budget is ignored.
+		void set_parallel_children(bool enable);
+
+		/// @brief Checks if the children of the job tick in parallel.
+		/// @return True if the children tick in parallel.
+		bool get_parallel_children( void ) const;
+
+		/// @brief Determines if the children of the job tick speculatively in parallel on the worker threads. Accesses to jobs outside of a child's sub-tree are detected, and the children making them are undone and ticked again serially after the parallel children have finished.
+		/// @param enable True to tick children speculatively.
+		/// @note Accesses are detected via ref::get_job, ref::operator->, immediate events, listening for completion, adding children and killing jobs. Direct pointers, such as from tree navigation, are not tracked. Only the state of the library and the data registered via register_state is undone.
+		/// @note ref::get_job returns null on a conflicting access, but ref::operator-> still performs it, so the access races with the siblings until the child is ticked again.
+		/// @note Children with jobs in their sub-trees whose data members are not all registered are not ticked speculatively, since they can not be undone. They tick serially after the parallel children instead.
+		/// @sa register_state
+		void set_speculative_children(bool enable);
+
+		/// @brief Checks if the children of the job tick speculatively.
+		/// @return True if the children tick speculatively.
+		bool get_speculative_children( void ) const;
+
+		/// @brief Registers user data that is saved before the job ticks speculatively, and restored if the tick is undone.
+		/// @param data The data. Must be trivially copyable, and must live as long as the job.
+		/// @param size The size of the data in bytes.
+		void register_state(void *data, uint64_t size);
+
+		/// @brief Registers user data that is saved before the job ticks speculatively, and restored if the tick is undone.
+		/// @tparam type_t The type of the data. Must be trivially copyable.
+		/// @param data The data. Must live as long as the job.
+		template < typename type_t >
+		void register_state(type_t &data);
+
+		/// @brief Records the changes made to the job and its sub-tree every cycle, so that the cycles can be undone using rewind.
+		/// @param cycles The number of most recent cycles that can be undone. Zero stops recording. Changing the length discards the recorded history.
+		/// @note Killed jobs are kept in a graveyard, rather than deleted, until the cycle in which they were killed is no longer recorded. Only the state of the library and the data registered via register_state is recorded.
+		/// @sa register_state
+		void set_history_length(uint64_t cycles);
+
+		/// @brief Returns the number of most recent cycles that can be undone.
+		/// @return The number of cycles. Zero if no history is recorded.
+		uint64_t get_history_length( void ) const;
+
+		/// @brief Undoes the most recent cycles of the job and its sub-tree. Jobs added during the cycles are deleted, and jobs killed during the cycles are revived.
+		/// @param cycles The number of cycles to undo. Changes made since the last cycle are always undone.
+		/// @return The number of cycles undone. Limited by the number of cycles recorded.
+		/// @note Must not be called while the job is cycling. Revived jobs do not receive another call to on_birth.
+		uint64_t rewind(uint64_t cycles);
+
+		/// @brief Publishes statistics about the job and its sub-tree to a shared memory object at the end of the job's cycles. Other processes read the statistics via read_stats without interrupting the ticking thread.
+		/// @param name The name of the shared memory object, starting with a slash. Null stops publishing and removes the object.
+		/// @param interval_cycles The number of cycles between publications. Cycle times are measured every cycle.
+		/// @return True if successful. Stopping via null always succeeds, while publishing always fails on platforms other than Linux.
+		/// @note Counting jobs visits every job in the sub-tree, so publishing large trees every cycle has a cost.
+		bool publish_stats(const char *name, uint64_t interval_cycles = 1);
+
+		/// @brief Reads the statistics published by a job tree, possibly in another process. Retries a bounded number of times until it reads a consistent copy.
+		/// @param name The name of the shared memory object.
+		/// @param out The statistics.
+		/// @return True if successful. False if the object does not exist, or if no consistent copy could be read, e.g. because the publisher died while writing. Always false on platforms other than Linux.
+		static bool read_stats(const char *name, stats &out);
+
+		/// @brief Opens a local socket through which an operator can change the settings of the job and its sub-tree while it runs. The socket is polled by run between cycles, without blocking.
+		/// @param path The path of the socket. Null closes the socket.
+		/// @return True if successful. False if something other than a socket already exists at the path. Always false on platforms other than Linux.
+		/// @note The socket is only accessible to the user running the process. A socket left behind at the path by a previous process is replaced.
+		/// @note Commands are lines of text of at most 255 characters, each answered with "ok <count>" or "error ...". Jobs are selected by class name, by ID with a leading '#', or all with '*': "tick_rate <jobs> <min> <max>" (0 0 removes the limit, otherwise 0 < min <= max), "time_scale <jobs> <scale>" (a positive, finite scale), "max_ticks <jobs> <count>", "cpu_quota <jobs> <quota> <window>", "parallel <jobs> on|off", "pause <jobs> on|off", "freeze <jobs> on|off", "stats <jobs> <name>|off [interval]", and "workers <count>".
+		/// @sa poll_control_socket
+		bool open_control_socket(const char *path);
+
+		/// @brief Executes the commands received via the control socket. Called automatically by run between cycles.
+		/// @note Must not be called while the job is cycling.
+		void poll_control_socket( void );
+
+		/// @brief Pins the job, and its sub-tree, to a lane when its parent ticks children in parallel. Lanes with pinned jobs are not shared with jobs that are not pinned, as long as there are other lanes.
+		/// @param lane The lane. Lane zero is the thread cycling the parent, and lane N is worker thread N. Clamped to the available lanes. UINT64_MAX unpins the job.
+		/// @sa set_lane_cpu
+		/// @sa set_lane_realtime_priority
+		void pin_to_lane(uint64_t lane);
+
+		/// @brief Returns the lane the job is pinned to.
+		/// @return The lane. UINT64_MAX if the job is not pinned.
+		uint64_t get_pinned_lane( void ) const;
+
+		/// @brief Restricts the thread executing a lane to a single CPU core, keeping the caches of jobs pinned to that lane warm.
+		/// @param lane The lane. Lane zero is the calling thread.
+		/// @param cpu The CPU core. -1 allows all cores.
+		/// @return True if successful. Always false on platforms other than Linux.
+		/// @note Changing the number of worker threads resets the settings of all lanes but lane zero.
+		static bool set_lane_cpu(uint64_t lane, int64_t cpu);
+
+		/// @brief Requests a real-time scheduling class (SCHED_FIFO) for the thread executing a lane, so that time-critical jobs pinned to the lane are not preempted by regular threads.
+		/// @param lane The lane. Lane zero is the calling thread.
+		/// @param priority The real-time priority. Zero returns the thread to regular scheduling.
+		/// @return True if successful. Usually requires elevated privileges. Always false on platforms other than Linux.
+		static bool set_lane_realtime_priority(uint64_t lane, int64_t priority);
+
+		/// @brief Returns a moving average of the real time spent cycling the job. Only measured when the parent ticks its children in parallel.
+		/// @return The time in nanoseconds.
+		uint64_t get_tick_cost_ns( void ) const;
+
+		/// @brief Returns the priority of the job relative to its siblings.
+		/// @return The priority.
+		int64_t get_priority( void ) const;
+
+		/// @brief Sets the deadline of the job. Used when the parent schedules children by deadline.
+		/// @param deadline_ns The time, local to the parent, by which the job should have ticked. Earlier deadlines tick first. Defaults to no deadline.
+		void set_deadline_ns(uint64_t deadline_ns);
+
+		/// @brief Returns the deadline of the job.
+		/// @return The deadline.
+		uint64_t get_deadline_ns( void ) const;
+
+		/// @brief Sets the amount of real time the children of the job are allowed to tick for each cycle. Once spent, the remaining children are deferred to the next cycle and accumulate the elapsed time.
+		/// @param budget_ns The budget in nanoseconds. Zero is unlimited.
+		/// @note At least one child ticks each cycle. Combine with a schedule so that less important children are deferred first.
+		/// @note Deferred children age so that they are not starved. Each cycle a child is deferred raises its priority by one, and when scheduling by deadline or in order, children deferred for more cycles tick first.
+		void set_child_budget_ns(uint64_t budget_ns);
+
+		/// @brief Returns the amount of real time the children of the job are allowed to tick for each cycle.
+		/// @return The budget in nanoseconds. Zero is unlimited.
+		uint64_t get_child_budget_ns( void ) const;
+
+		/// @brief Makes the job tick after a sibling, regardless of schedule. Jobs without dependencies between them may still tick in any order.
+		/// @param sibling The sibling to tick after.
+		/// @return True if the job ticks after the sibling, including if the dependency already existed. False if the job is not a sibling.
+		/// @note Dependencies forming a cycle are ignored.
+		bool run_after(job &sibling);
+
+		/// @brief Limits the processor time that the job and its sub-tree may use over a sliding window of real time. Once exceeded, cycles of the job are deferred, accumulating the elapsed time, until usage is back within the quota.
+		/// @param quota_ns The processor time in nanoseconds allowed within each window. Zero is unlimited.
+		/// @param window_ns The length of the window in nanoseconds.
+		/// @note Processor time is measured on the thread cycling the job. Time spent on worker threads ticking children in parallel is not counted.
+		void set_cpu_quota(uint64_t quota_ns, uint64_t window_ns);
+
+		/// @brief Returns the processor time that the job and its sub-tree may use within each window.
+		/// @return The quota in nanoseconds. Zero is unlimited.
+		uint64_t get_cpu_quota_ns( void ) const;
+
+		/// @brief Returns the length of the window that the processor time quota applies to.
+		/// @return The window in nanoseconds. Zero if unlimited.
+		uint64_t get_cpu_quota_window_ns( void ) const;
+
+		/// @brief Checks if the job was deferred the last time it was cycled because it exceeded its processor time quota.
+		/// @return True if throttled.
+		bool is_throttled( void ) const;
+
+		/// @brief Delivers all queued events on the calling thread. Events sent during delivery are queued until the next delivery.
+		/// @note This is done automatically after every root cycle.
+		/// @note May be called from an event callback, in which case the events sent so far during the current delivery are delivered before returning.
+		static void dispatch_events( void );
+
 		/// @brief Returns a safe reference that will automatically turn null if the job is deleted.
 		/// @return The reference.
 		ref<> get_ref( void );
@@ -918,6 +2245,27 @@ namespace cc0
 		template < typename job_t >
 		static bool register_job(const char *type_name);
 
+		/// @brief Links the declared listeners of a job class derivative to those of the class it derives from and calls the declare_listeners function of the class.
+		/// @tparam job_t The type of the job class derivative.
+		/// @param base_id The type ID of the class derived from.
+		/// @return True.
+		/// @note Do not use this function directly. Called automatically before the first instance of a class is created.
+		template < typename job_t >
+		static bool declare_type(uint64_t base_id);
+
+		/// @brief Tells a job which of on_tick and on_tock need to be called, the size of its class, and which events its class declares listeners for. Empty defaults are skipped when cycling.
+		/// @param j The job.
+		/// @param tick Indicates that on_tick is overridden.
+		/// @param tock Indicates that on_tock is overridden.
+		/// @param size The size of the class in bytes.
+		/// @param align The alignment of the class in bytes.
+		/// @param type_id The type ID of the class.
+		/// @note Do not use this function directly. Called automatically by each class in the inheritance chain, with the most derived class called last.
+		static void set_hooks(job &j, bool tick, bool tock, uint64_t size, uint64_t align, uint64_t type_id);
+
+		/// @brief Does nothing. Selected while constructing the base of cc0::job itself.
+		static void set_hooks(jobs_internal::rtti&, bool, bool, uint64_t, uint64_t, uint64_t);
+
 		/// @brief Traverses the child tree and counts the number of child jobs present under this parent.
 		/// @return The number of child jobs present under this parent.
 		uint64_t count_children( void ) const;
@@ -995,6 +2343,102 @@ namespace cc0
 		template < typename job_t = cc0::job >
 		void defer(void (job_t::*mem_fn)(job&), uint64_t delay_ns);
 
+		/// @brief Ensures that the library's memory pools can serve a number of allocations of a given size without allocating heap memory.
+		/// @param size The size of the allocations.
+		/// @param count The number of allocations.
+		/// @note Pools keep memory that is returned to them, so a job tree that has warmed up no longer allocates heap memory for library structures.
+		static void reserve_memory(uint64_t size, uint64_t count);
+
+		/// @brief Ensures that the library's memory pools can serve a number of allocations of a given type without allocating heap memory.
+		/// @tparam type_t The type to reserve memory for.
+		/// @param count The number of allocations.
+		template < typename type_t >
+		static void reserve_memory(uint64_t count);
+
+		/// @brief Determines if the library allocates memory for jobs and library structures in huge pages (2 MB), reducing TLB misses when walking large job trees.
+		/// @param enable True to allocate memory in huge pages.
+		/// @note Falls back to transparent huge pages, and finally regular heap memory, if huge pages are not available. Only affects memory allocated after the call.
+		static void use_huge_pages(bool enable);
+
+		/// @brief Sets the NUMA node that memory for jobs and library structures allocated by the calling thread should be placed on.
+		/// @param node The NUMA node. -1 for no preference.
+		/// @return True if the node is valid.
+		/// @note Call this on each thread that builds a sub-tree so that the sub-tree is allocated on the node local to the thread.
+		static bool set_memory_node(int64_t node);
+
+		/// @brief Returns the NUMA node that memory for jobs and library structures allocated by the calling thread is placed on.
+		/// @return The NUMA node. -1 for no preference.
+		static int64_t get_memory_node( void );
+
+		/// @brief Sets a function that is called whenever the library allocates heap memory on a thread that is currently cycling a job tree.
+		/// @param trap The function. Null disables the trap.
+		/// @note Define CC0_JOBS_TRAP_ALLOCATIONS in exactly one source file before including this header to also trap heap allocations made outside of the library.
+		static void set_allocation_trap(jobs_internal::allocation_trap trap);
+
+		/// @brief Allocates temporary memory that remains valid until the end of the current root cycle on the calling thread.
+		/// @param size The number of bytes to allocate.
+		/// @param align The required alignment of the memory. Must be a power of two.
+		/// @return The memory.
+		/// @note Allocations made outside of a cycle remain valid until the end of the next root cycle on the calling thread.
+		/// @note Allocations made by children ticked on worker threads remain valid until the end of the root cycle that ticked them.
+		static void *scratch_alloc(uint64_t size, uint64_t align = alignof(uint64_t));
+
+		/// @brief Allocates and default constructs temporary objects that remain valid until the end of the current root cycle on the calling thread.
+		/// @tparam type_t The type of the objects.
+		/// @param count The number of objects to allocate.
+		/// @return The first object in an array of objects.
+		/// @warning Destructors are never called on the objects. Only use types that do not need to be destroyed.
+		template < typename type_t >
+		static type_t *scratch_new(uint64_t count = 1);
+
+		/// @brief Calls a function for every index in a range, spreading the work over the worker threads. The calling thread helps execute the work and returns once all indices have been processed.
+		/// @tparam fn_t A function, or function object, taking an index as input.
+		/// @param begin The first index.
+		/// @param end One past the last index.
+		/// @param fn The function.
+		/// @param grain The number of indices per chunk of work. Zero picks a number automatically.
+		/// @note Parallel loops started from within a parallel loop run serially.
+		/// @note If the function throws, the chunks not yet started are skipped, and the first exception is rethrown on the calling thread once the other threads have finished.
+		/// @warning The function is called from multiple threads at once. It must not modify the job tree, allocate library memory, or send events.
+		template < typename fn_t >
+		static void parallel_for(uint64_t begin, uint64_t end, const fn_t &fn, uint64_t grain = 0);
+
+		/// @brief Maps every index in a range to a value and combines the values, spreading the work over the worker threads. The calling thread helps execute the work.
+		/// @tparam value_t The type of the value.
+		/// @tparam fn_t A function, or function object, taking an index as input and returning a value.
+		/// @tparam op_t A function, or function object, taking two values as input and returning their combination. Must be associative.
+		/// @param begin The first index.
+		/// @param end One past the last index.
+		/// @param identity The value that leaves other values unchanged when combined with them.
+		/// @param fn The function.
+		/// @param op The combining function.
+		/// @param grain The number of indices per chunk of work. Zero picks a number automatically.
+		/// @return The combined value. Values are combined in index order, so the result does not depend on the number of threads.
+		/// @note If a function throws, the chunks not yet started are skipped, and the first exception is rethrown on the calling thread once the other threads have finished.
+		/// @warning The functions are called from multiple threads at once. They must not modify the job tree, allocate library memory, or send events.
+		template < typename value_t, typename fn_t, typename op_t >
+		static value_t parallel_reduce(uint64_t begin, uint64_t end, const value_t &identity, const fn_t &fn, const op_t &op, uint64_t grain = 0);
+
+		/// @brief Evaluates what-if scenarios on copies of the job tree. Every scenario runs in its own forked process, which shares memory pages with the calling process until either writes to them, so the tree is never copied up front. The scenarios run concurrently, and the call returns when all have finished.
+		/// @tparam result_t The type of the result of a scenario. Must be trivially copyable.
+		/// @tparam fn_t A function, or function object, taking the forked copy of the job and the index of the scenario as input and returning a result. It typically applies inputs and cycles the tree.
+		/// @param count The number of scenarios.
+		/// @param fn The function.
+		/// @param results An array of results, one per scenario. Results of scenarios that failed are left unchanged.
+		/// @return The number of scenarios that reported a result. Always zero on platforms other than Linux.
+		/// @note Changes made by the scenarios are never visible to the calling process. Worker threads do not survive forking, so parallel work within a scenario runs serially. A scenario that throws an exception reports no result.
+		/// @note Returns zero without forking when called from a worker lane or a parallel loop. The locks of the library are held while forking, but locks held by other threads of the application at that moment stay locked in the scenarios forever, so a scenario that takes such a lock deadlocks.
+		template < typename result_t, typename fn_t >
+		uint64_t fork_scenarios(uint64_t count, const fn_t &fn, result_t *results);
+
+		/// @brief Sets the number of worker threads used by the library, not counting the calling thread. Must not be called while a parallel loop is running.
+		/// @param count The number of worker threads.
+		static void set_worker_count(uint64_t count);
+
+		/// @brief Returns the number of worker threads used by the library, not counting the calling thread.
+		/// @return The number of worker threads. Defaults to one per additional hardware thread.
+		static uint64_t get_worker_count( void );
+
 		/// @brief Continues execution until the job is no longer enabled.
 		/// @param fixed_duration_ns The time slice to use as input when cycling the job. 0 (default) will use real time.
 		/// @note This is the function that users want to trigger manually for root nodes as it will perform timing and continuously execute until the job, and its sub-jobs, are finished.
@@ -1042,6 +2486,39 @@ const type_t *cc0::jobs_internal::rtti::cast( void ) const
 	return reinterpret_cast<const type_t*>(self(type_t::type_id()));
 }
 
+//
+// type_key
+//
+
+template < typename type_t >
+uint64_t cc0::jobs_internal::type_key<type_t>::id( void )
+{
+	static const uint64_t id = cc0::jobs_internal::new_uuid();
+	return id;
+}
+
+//
+// listener_declarations
+//
+
+template < typename type_t >
+template < typename self_t >
+auto cc0::jobs_internal::listener_declarations<type_t>::declare(int) -> decltype(self_t::declare_listeners(), void())
+{
+	self_t::declare_listeners();
+}
+
+template < typename type_t >
+template < typename self_t >
+void cc0::jobs_internal::listener_declarations<type_t>::declare(long)
+{}
+
+template < typename type_t >
+void cc0::jobs_internal::listener_declarations<type_t>::declare( void )
+{
+	declare<type_t>(0);
+}
+
 //
 // search_tree
 //
@@ -1093,13 +2570,29 @@ bool cc0::jobs_internal::search_tree<type_t,key_t>::kcmp(const char *a, const ch
 	return (*a == *b);
 }
 
+template < typename type_t, typename key_t >
+typename cc0::jobs_internal::search_tree<type_t,key_t>::node *cc0::jobs_internal::search_tree<type_t,key_t>::new_node(uint64_t hash, const key_t &key, const type_t &value)
+{
+	void *p = m_arena != nullptr ? m_arena->allocate(sizeof(node), alignof(node)) : cc0::jobs_internal::allocate(sizeof(node));
+	return new (p) node{ hash, key, nullptr, nullptr, value };
+}
+
+template < typename type_t, typename key_t >
+void cc0::jobs_internal::search_tree<type_t,key_t>::delete_node(cc0::jobs_internal::search_tree<type_t,key_t>::node *n)
+{
+	n->~node();
+	if (m_arena == nullptr) {
+		cc0::jobs_internal::deallocate(n, sizeof(node));
+	}
+}
+
 template < typename type_t, typename key_t >
 void cc0::jobs_internal::search_tree<type_t,key_t>::free_node(cc0::jobs_internal::search_tree<type_t,key_t>::node *n)
 {
 	if (n != nullptr) {
 		free_node(n->lte);
 		free_node(n->gt);
-		delete n;
+		delete_node(n);
 	}
 }
 
@@ -1115,7 +2608,22 @@ void cc0::jobs_internal::search_tree<type_t,key_t>::traverse(fn_t &fn, cc0::jobs
 }
 
 template < typename type_t, typename key_t >
-cc0::jobs_internal::search_tree<type_t,key_t>::search_tree( void ) : m_root(nullptr) 
+template < typename fn_t >
+void cc0::jobs_internal::search_tree<type_t,key_t>::traverse_keys(fn_t &fn, cc0::jobs_internal::search_tree<type_t,key_t>::node *n)
+{
+	if (n != nullptr) {
+		traverse_keys(fn, n->lte);
+		fn(n->key, n->value);
+		traverse_keys(fn, n->gt);
+	}
+}
+
+template < typename type_t, typename key_t >
+cc0::jobs_internal::search_tree<type_t,key_t>::search_tree( void ) : m_root(nullptr), m_arena(nullptr)
+{}
+
+template < typename type_t, typename key_t >
+cc0::jobs_internal::search_tree<type_t,key_t>::search_tree(cc0::jobs_internal::scratch_arena *arena) : m_root(nullptr), m_arena(arena)
 {}
 
 template < typename type_t, typename key_t >
@@ -1140,7 +2648,7 @@ type_t *cc0::jobs_internal::search_tree<type_t,key_t>::add(const key_t &key, con
 			n = &((*n)->gt);
 		}
 	}
-	*n = new node{ hash, key, nullptr, nullptr, value };
+	*n = new_node(hash, key, value);
 	return &((*n)->value);
 }
 
@@ -1229,7 +2737,7 @@ void cc0::jobs_internal::search_tree<type_t,key_t>::remove(const key_t &key)
 			n->lte = nullptr;
 			n->gt  = nullptr;
 		}
-		delete n;
+		delete_node(n);
 	}
 }
 
@@ -1240,6 +2748,13 @@ void cc0::jobs_internal::search_tree<type_t,key_t>::traverse(fn_t &fn)
 	traverse(fn, m_root);
 }
 
+template < typename type_t, typename key_t >
+template < typename fn_t >
+void cc0::jobs_internal::search_tree<type_t,key_t>::traverse_keys(fn_t &fn)
+{
+	traverse_keys(fn, m_root);
+}
+
 //
 // inherit
 //
@@ -1247,6 +2762,42 @@ void cc0::jobs_internal::search_tree<type_t,key_t>::traverse(fn_t &fn)
 template < typename self_t, typename self_type_name_t, typename base_t >
 const bool cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::m_registered = cc0::job::register_job<self_t>(cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::type_name());
 
+template < typename self_t, typename self_type_name_t, typename base_t >
+cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::inherit( void ) : base_t()
+{
+	static const bool declared = cc0::job::declare_type<self_t>(base_t::type_id());
+	(void)declared;
+	cc0::job::set_hooks(*this, overrides_tick<self_t>(0), overrides_tock<self_t>(0), sizeof(self_t), alignof(self_t), type_id());
+}
+
+template < typename self_t, typename self_type_name_t, typename base_t >
+template < typename type_t >
+auto cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::overrides_tick(int) -> decltype(&type_t::on_tick, bool())
+{
+	return cc0::jobs_internal::hook<decltype(&type_t::on_tick)>::overridden;
+}
+
+template < typename self_t, typename self_type_name_t, typename base_t >
+template < typename type_t >
+bool cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::overrides_tick(long)
+{
+	return true;
+}
+
+template < typename self_t, typename self_type_name_t, typename base_t >
+template < typename type_t >
+auto cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::overrides_tock(int) -> decltype(&type_t::on_tock, bool())
+{
+	return cc0::jobs_internal::hook<decltype(&type_t::on_tock)>::overridden;
+}
+
+template < typename self_t, typename self_type_name_t, typename base_t >
+template < typename type_t >
+bool cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::overrides_tock(long)
+{
+	return true;
+}
+
 template < typename self_t, typename self_type_name_t, typename base_t >
 void *cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::self(uint64_t type_id)
 {
@@ -1296,6 +2847,18 @@ bool cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::is_registered(
 	return m_registered;
 }
 
+template < typename self_t, typename self_type_name_t, typename base_t >
+void *cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::operator new(std::size_t size)
+{
+	return cc0::jobs_internal::allocate(size, CC0_JOBS_CALL_SITE);
+}
+
+template < typename self_t, typename self_type_name_t, typename base_t >
+void cc0::jobs_internal::inherit<self_t,self_type_name_t,base_t>::operator delete(void *p, std::size_t size)
+{
+	cc0::jobs_internal::deallocate(p, size);
+}
+
 //
 // mem_callback
 //
@@ -1305,10 +2868,30 @@ cc0::job::mem_callback<job_t>::mem_callback(job_t *self, void (job_t::*fn)(cc0::
 {}
 
 template < typename job_t >
-void cc0::job::mem_callback<job_t>::operator()(cc0::job &sender)
+void cc0::job::mem_callback<job_t>::operator()(cc0::job &receiver, cc0::job &sender, const cc0::job::payload&)
 {
-	if (m_self != nullptr && m_memfn != nullptr) {
-		(m_self->*m_memfn)(sender);
+	job_t *self = m_self != nullptr ? m_self : receiver.cast<job_t>();
+	if (self != nullptr && m_memfn != nullptr) {
+		(self->*m_memfn)(sender);
+	}
+}
+
+//
+// payload_callback
+//
+
+template < typename job_t, typename payload_t >
+cc0::job::payload_callback<job_t,payload_t>::payload_callback(job_t *self, void (job_t::*fn)(cc0::job&, const payload_t&)) : m_self(self), m_memfn(fn)
+{}
+
+template < typename job_t, typename payload_t >
+void cc0::job::payload_callback<job_t,payload_t>::operator()(cc0::job &receiver, cc0::job &sender, const cc0::job::payload &data)
+{
+	if (m_memfn != nullptr && data.data != nullptr && data.type == cc0::jobs_internal::type_key<payload_t>::id()) {
+		job_t *self = m_self != nullptr ? m_self : receiver.cast<job_t>();
+		if (self != nullptr) {
+			(self->*m_memfn)(sender, *reinterpret_cast<const payload_t*>(data.data));
+		}
 	}
 }
 
@@ -1323,6 +2906,13 @@ void cc0::job::callback::set(job_t *self, void (job_t::*fn)(cc0::job&))
 	m_callback = new mem_callback<job_t>(self, fn);
 }
 
+template < typename job_t, typename payload_t >
+void cc0::job::callback::set(job_t *self, void (job_t::*fn)(cc0::job&, const payload_t&))
+{
+	delete m_callback;
+	m_callback = new payload_callback<job_t,payload_t>(self, fn);
+}
+
 //
 // ref
 //
@@ -1336,7 +2926,7 @@ template < typename job2_t >
 cc0::job::ref<job_t>::ref(job2_t *p) : m_job(p), m_shared(p != nullptr ? p->m_shared : nullptr)
 {
 	if (m_shared != nullptr) {
-		++m_shared->watchers;
+		CC0_JOBS_ATOMIC_ADD(m_shared->watchers, 1);
 	}
 }
 
@@ -1399,7 +2989,7 @@ void cc0::job::ref<job_t>::set_ref(job2_t *p)
 		if (p != nullptr) {
 			m_job = p;
 			m_shared = m_job->m_shared;
-			++m_shared->watchers;
+			CC0_JOBS_ATOMIC_ADD(m_shared->watchers, 1);
 		}
 	}
 }
@@ -1408,8 +2998,7 @@ template < typename job_t >
 void cc0::job::ref<job_t>::release( void )
 {
 	if (m_shared != nullptr) {
-		--m_shared->watchers;
-		if (m_shared->watchers == 0 && m_shared->deleted) {
+		if (CC0_JOBS_ATOMIC_SUB(m_shared->watchers, 1) == 0) {
 			delete m_shared;
 		}
 	}
@@ -1420,13 +3009,15 @@ void cc0::job::ref<job_t>::release( void )
 template < typename job_t >
 job_t *cc0::job::ref<job_t>::get_job( void )
 {
-	return m_shared != nullptr && !m_shared->deleted ? m_job : nullptr;
+	job_t *j = m_shared != nullptr && !CC0_JOBS_ATOMIC_LOAD(m_shared->deleted) ? m_job : nullptr;
+	return j == nullptr || cc0::jobs_internal::speculation_root == nullptr || cc0::job::track_access(j) ? j : nullptr;
 }
 
 template < typename job_t >
 const job_t *cc0::job::ref<job_t>::get_job( void ) const
 {
-	return m_shared != nullptr && !m_shared->deleted ? m_job : nullptr;
+	const job_t *j = m_shared != nullptr && !CC0_JOBS_ATOMIC_LOAD(m_shared->deleted) ? m_job : nullptr;
+	return j == nullptr || cc0::jobs_internal::speculation_root == nullptr || cc0::job::track_access(j) ? j : nullptr;
 }
 
 template < typename job_t >
@@ -1439,15 +3030,90 @@ cc0::job::ref<job2_t> cc0::job::ref<job_t>::cast( void )
 template < typename job_t >
 job_t *cc0::job::ref<job_t>::operator->( void )
 {
+	if (cc0::jobs_internal::speculation_root != nullptr) {
+		cc0::job::track_access(m_job);
+	}
 	return m_job;
 }
 
+template < typename job_t >
+bool cc0::job::ref<job_t>::is_complete( void ) const
+{
+	return m_shared != nullptr && m_shared->completed;
+}
+
+template < typename job_t >
+template < typename result_t >
+const result_t *cc0::job::ref<job_t>::get_result( void ) const
+{
+	return is_complete() && m_shared->result.data != nullptr && m_shared->result.type == cc0::jobs_internal::type_key<result_t>::id() ? reinterpret_cast<const result_t*>(m_shared->result.data) : nullptr;
+}
+
 template < typename job_t >
 const job_t *cc0::job::ref<job_t>::operator->( void ) const
 {
+	if (cc0::jobs_internal::speculation_root != nullptr) {
+		cc0::job::track_access(m_job);
+	}
 	return m_job;
 }
 
+//
+// buffered
+//
+
+template < typename type_t >
+void cc0::job::buffered<type_t>::commit( void )
+{
+	m_current = m_next;
+}
+
+template < typename type_t >
+cc0::job::buffered<type_t>::buffered( void ) : cc0::jobs_internal::buffered_base(), m_current(), m_next()
+{}
+
+template < typename type_t >
+cc0::job::buffered<type_t>::buffered(const type_t &value) : cc0::jobs_internal::buffered_base(), m_current(value), m_next(value)
+{}
+
+template < typename type_t >
+const type_t &cc0::job::buffered<type_t>::get( void ) const
+{
+	return m_current;
+}
+
+template < typename type_t >
+const type_t &cc0::job::buffered<type_t>::operator*( void ) const
+{
+	return m_current;
+}
+
+template < typename type_t >
+const type_t *cc0::job::buffered<type_t>::operator->( void ) const
+{
+	return &m_current;
+}
+
+template < typename type_t >
+void cc0::job::buffered<type_t>::set(const type_t &value)
+{
+	mark_dirty();
+	m_next = value;
+}
+
+template < typename type_t >
+type_t &cc0::job::buffered<type_t>::next( void )
+{
+	mark_dirty();
+	return m_next;
+}
+
+template < typename type_t >
+const type_t &cc0::job::buffered<type_t>::peek_next( void ) const
+{
+	return m_next;
+}
+
 //
 // results
 //
@@ -1472,6 +3138,98 @@ cc0::job::query::results cc0::job::query::results::filter_results( void )
 	return filter_results<query_t>(query_t());
 }
 
+//
+// components
+//
+
+template < typename component_t >
+cc0::job::components<component_t>::components( void ) : m_data(nullptr), m_owners(nullptr), m_count(0), m_capacity(0)
+{}
+
+template < typename component_t >
+cc0::job::components<component_t>::~components( void )
+{
+	delete [] m_data;
+	delete [] m_owners;
+}
+
+template < typename component_t >
+cc0::job::components<component_t> &cc0::job::components<component_t>::instance( void )
+{
+	static components *pool = new components; // Never destroyed, so that jobs deleted during static destruction can still detach their components.
+	return *pool;
+}
+
+template < typename component_t >
+uint64_t cc0::job::components<component_t>::add(cc0::job &owner)
+{
+	if (m_count == m_capacity) {
+		const uint64_t capacity = m_capacity > 0 ? m_capacity * 2 : 16;
+		component_t *data = new component_t[capacity];
+		job **owners = new job*[capacity];
+		for (uint64_t i = 0; i < m_count; ++i) {
+			data[i] = static_cast<component_t&&>(m_data[i]);
+			owners[i] = m_owners[i];
+		}
+		delete [] m_data;
+		delete [] m_owners;
+		m_data = data;
+		m_owners = owners;
+		m_capacity = capacity;
+	}
+	m_owners[m_count] = &owner;
+	return m_count++;
+}
+
+template < typename component_t >
+void cc0::job::components<component_t>::remove(uint64_t index)
+{
+	const uint64_t last = --m_count;
+	if (index != last) {
+		m_data[index] = static_cast<component_t&&>(m_data[last]);
+		m_owners[index] = m_owners[last];
+		m_owners[index]->m_components.get(cc0::jobs_internal::type_key<component_t>::id())->index = index;
+	}
+	m_data[last] = component_t(); // Release any resources held by the component.
+	m_owners[last] = nullptr;
+}
+
+template < typename component_t >
+void cc0::job::components<component_t>::detach(uint64_t index)
+{
+	instance().remove(index);
+}
+
+template < typename component_t >
+uint64_t cc0::job::components<component_t>::count( void ) const
+{
+	return m_count;
+}
+
+template < typename component_t >
+component_t &cc0::job::components<component_t>::operator[](uint64_t i)
+{
+	return m_data[i];
+}
+
+template < typename component_t >
+const component_t &cc0::job::components<component_t>::operator[](uint64_t i) const
+{
+	return m_data[i];
+}
+
+template < typename component_t >
+cc0::job *cc0::job::components<component_t>::get_owner(uint64_t i)
+{
+	return m_owners[i];
+}
+
+template < typename component_t >
+const cc0::job *cc0::job::components<component_t>::get_owner(uint64_t i) const
+{
+	return m_owners[i];
+}
+
 //
 // job
 //
@@ -1487,6 +3245,7 @@ void cc0::job::listen(const char *event, void (job_t::*fn)(cc0::job&))
 		}
 		callback *c = t->add(event, callback());
 		c->set<job_t>(self, fn);
+		add_listen_bloom(event_bloom(event));
 	}
 }
 
@@ -1501,25 +3260,297 @@ void cc0::job::listen(const char *event, const cc0::job &sender, void (job_t::*f
 		}
 		callback *c = t->add(event, callback());
 		c->set<job_t>(self, fn);
+		add_listen_bloom(event_bloom(event));
 	}
 }
 
+template < typename job_t, typename payload_t >
+void cc0::job::listen(const char *event, void (job_t::*fn)(cc0::job&, const payload_t&))
+{
+	job_t *self = cast<job_t>();
+	if (self != nullptr) {
+		callback_tree *t = m_event_callbacks.get(0);
+		if (t == nullptr) {
+			t = m_event_callbacks.add(0, callback_tree());
+		}
+		callback *c = t->add(event, callback());
+		c->set<job_t,payload_t>(self, fn);
+		add_listen_bloom(event_bloom(event));
+	}
+}
+
+template < typename job_t, typename payload_t >
+void cc0::job::listen(const char *event, const cc0::job &sender, void (job_t::*fn)(cc0::job&, const payload_t&))
+{
+	job_t *self = cast<job_t>();
+	if (self != nullptr) {
+		callback_tree *t = m_event_callbacks.get(sender.get_job_id());
+		if (t == nullptr) {
+			t = m_event_callbacks.add(sender.get_job_id(), callback_tree());
+		}
+		callback *c = t->add(event, callback());
+		c->set<job_t,payload_t>(self, fn);
+		add_listen_bloom(event_bloom(event));
+	}
+}
+
+template < typename job_t >
+void cc0::job::declare_listener(const char *event, void (job_t::*fn)(cc0::job&))
+{
+	type_listeners *t = get_type_listeners(job_t::type_id(), true);
+	callback *c = t->callbacks.add(event, callback());
+	c->set<job_t>(nullptr, fn);
+	t->bloom |= event_bloom(event);
+}
+
+template < typename job_t, typename payload_t >
+void cc0::job::declare_listener(const char *event, void (job_t::*fn)(cc0::job&, const payload_t&))
+{
+	type_listeners *t = get_type_listeners(job_t::type_id(), true);
+	callback *c = t->callbacks.add(event, callback());
+	c->set<job_t,payload_t>(nullptr, fn);
+	t->bloom |= event_bloom(event);
+}
+
+template < typename job_t >
+void cc0::job::when_complete(cc0::job &target, void (job_t::*fn)(cc0::job&))
+{
+	listen<job_t>(completion_event(), target, fn);
+	if (target.is_complete()) {
+		get_notified(completion_event(), target, target.m_shared->result);
+		ignore(completion_event(), target);
+	} else {
+		target.add_completion_waiter(*this);
+	}
+}
+
+template < typename job_t, typename result_t >
+void cc0::job::when_complete(cc0::job &target, void (job_t::*fn)(cc0::job&, const result_t&))
+{
+	listen<job_t,result_t>(completion_event(), target, fn);
+	if (target.is_complete()) {
+		get_notified(completion_event(), target, target.m_shared->result);
+		ignore(completion_event(), target);
+	} else {
+		target.add_completion_waiter(*this);
+	}
+}
+
+template < typename type_t >
+void cc0::job::register_state(type_t &data)
+{
+	register_state(&data, sizeof(type_t));
+}
+
+template < typename result_t >
+void cc0::job::set_result(const result_t &result)
+{
+	static_assert(std::is_trivially_copyable<result_t>::value, "Results are copied byte by byte, and outlive the job, so they must be trivially copyable.");
+	m_shared->set_result(make_payload(result));
+}
+
+template < typename payload_t >
+cc0::job::payload cc0::job::make_payload(const payload_t &data)
+{
+	static_assert(std::is_trivially_copyable<payload_t>::value, "Event data is copied byte by byte when it is queued, so it must be trivially copyable.");
+	static_assert(alignof(payload_t) <= CC0_JOBS_MAX_PAYLOAD_ALIGN, "Queued event data is stored in memory aligned to CC0_JOBS_MAX_PAYLOAD_ALIGN bytes.");
+	return payload{ &data, cc0::jobs_internal::type_key<payload_t>::id(), sizeof(payload_t), alignof(payload_t) };
+}
+
+template < typename payload_t >
+void cc0::job::notify_parent(const char *event, const payload_t &data)
+{
+	send_parent(event, make_payload(data));
+}
+
+template < typename payload_t >
+void cc0::job::notify_children(const char *event, const payload_t &data)
+{
+	send_children(event, make_payload(data));
+}
+
+template < typename payload_t >
+void cc0::job::notify_decendants(const char *event, const payload_t &data)
+{
+	send_decendants(event, make_payload(data));
+}
+
+template < typename payload_t >
+void cc0::job::notify_group(const char *event, cc0::job::query::results &group, const payload_t &data)
+{
+	send_group(event, group, make_payload(data));
+}
+
+template < typename payload_t >
+void cc0::job::notify(const char *event, cc0::job &target, const payload_t &data)
+{
+	send(event, target, make_payload(data));
+}
+
 template < typename job_t >
 job_t *cc0::job::add_child( void )
 {
 	job_t *p = nullptr;
-	if (!is_killed()) {
+	if (!is_killed() && (cc0::jobs_internal::speculation_root == nullptr || track_change(this))) {
 		p = new job_t;
 		add_sibling(m_child, p);
 		cc0::job *b = dynamic_cast<cc0::job*>(p);
+		b->m_speculative = cc0::jobs_internal::speculation_root != nullptr;
+		if (!b->m_speculative) {
+			b->record_spawn();
+		}
 		b->m_created_at_ns = get_local_time_ns();
 		b->m_min_duration_ns = m_min_duration_ns;
 		b->m_max_duration_ns = m_max_duration_ns;
+		b->m_delivery = m_delivery;
+		add_subtree_bloom(b->m_subtree_bloom);
+		m_schedule_dirty = true;
 		b->on_birth();
 	}
 	return p;
 }
 
+template < typename component_t >
+component_t *cc0::job::add_component( void )
+{
+	if (is_killed()) {
+		return nullptr;
+	}
+	const uint64_t key = cc0::jobs_internal::type_key<component_t>::id();
+	components<component_t> &pool = components<component_t>::instance();
+	cc0::jobs_internal::component_lock lock;
+	component_slot *s = m_components.get(key);
+	if (s == nullptr) {
+		s = m_components.add(key, component_slot{ pool.add(*this), components<component_t>::detach });
+	}
+	return &pool[s->index];
+}
+
+template < typename component_t >
+component_t *cc0::job::get_component( void )
+{
+	cc0::jobs_internal::component_lock lock; // Another job may move the component while it is looked up.
+	component_slot *s = m_components.get(cc0::jobs_internal::type_key<component_t>::id());
+	return s != nullptr ? &components<component_t>::instance()[s->index] : nullptr;
+}
+
+template < typename component_t >
+const component_t *cc0::job::get_component( void ) const
+{
+	cc0::jobs_internal::component_lock lock; // Another job may move the component while it is looked up.
+	const component_slot *s = m_components.get(cc0::jobs_internal::type_key<component_t>::id());
+	return s != nullptr ? &components<component_t>::instance()[s->index] : nullptr;
+}
+
+template < typename component_t >
+void cc0::job::remove_component( void )
+{
+	const uint64_t key = cc0::jobs_internal::type_key<component_t>::id();
+	cc0::jobs_internal::component_lock lock;
+	component_slot *s = m_components.get(key);
+	if (s != nullptr) {
+		components<component_t>::detach(s->index);
+		m_components.remove(key);
+	}
+}
+
+template < typename component_t >
+cc0::job::components<component_t> &cc0::job::get_components( void )
+{
+	return components<component_t>::instance();
+}
+
+template < typename type_t >
+void cc0::job::reserve_memory(uint64_t count)
+{
+	reserve_memory(sizeof(type_t), count);
+}
+
+template < typename type_t >
+type_t *cc0::job::scratch_new(uint64_t count)
+{
+	type_t *p = reinterpret_cast<type_t*>(scratch_alloc(sizeof(type_t) * count, alignof(type_t)));
+	for (uint64_t i = 0; i < count; ++i) {
+		new (p + i) type_t;
+	}
+	return p;
+}
+
+template < typename fn_t >
+void cc0::job::parallel_for_chunk(void *context, uint64_t, uint64_t begin, uint64_t end)
+{
+	const fn_t &fn = *reinterpret_cast<const fn_t*>(context);
+	for (uint64_t i = begin; i < end; ++i) {
+		fn(i);
+	}
+}
+
+template < typename fn_t >
+void cc0::job::parallel_for(uint64_t begin, uint64_t end, const fn_t &fn, uint64_t grain)
+{
+	cc0::jobs_internal::parallel_range(begin, end, grain, parallel_for_chunk<fn_t>, const_cast<fn_t*>(&fn));
+}
+
+template < typename reduce_t >
+void cc0::job::parallel_reduce_chunk(void *context, uint64_t chunk, uint64_t begin, uint64_t end)
+{
+	reduce_t &r = *reinterpret_cast<reduce_t*>(context);
+	for (uint64_t i = begin; i < end; ++i) {
+		r.partials[chunk] = (*r.op)(r.partials[chunk], (*r.fn)(i));
+	}
+}
+
+template < typename value_t, typename fn_t, typename op_t >
+value_t cc0::job::parallel_reduce(uint64_t begin, uint64_t end, const value_t &identity, const fn_t &fn, const op_t &op, uint64_t grain)
+{
+	if (begin >= end) {
+		return identity;
+	}
+	struct reduce
+	{
+		const fn_t *fn;
+		const op_t *op;
+		value_t    *partials;
+	};
+	grain = cc0::jobs_internal::parallel_grain(end - begin, grain);
+	const uint64_t chunks = (end - begin + grain - 1) / grain;
+	struct partials
+	{
+		value_t  *values;
+		uint64_t  count;
+		~partials( void ) {
+			for (uint64_t c = 0; c < count; ++c) {
+				values[c].~value_t(); // Scratch memory is released without destroying what it holds.
+			}
+		}
+	};
+	reduce r = { &fn, &op, reinterpret_cast<value_t*>(scratch_alloc(sizeof(value_t) * chunks, alignof(value_t))) }; // One partial result per chunk so that threads never share a value.
+	partials constructed = { r.partials, 0 };
+	for (; constructed.count < chunks; ++constructed.count) {
+		new (r.partials + constructed.count) value_t(identity);
+	}
+	cc0::jobs_internal::parallel_range(begin, end, grain, parallel_reduce_chunk<reduce>, &r);
+	value_t result = identity;
+	for (uint64_t c = 0; c < chunks; ++c) {
+		result = op(result, r.partials[c]);
+	}
+	return result;
+}
+
+template < typename result_t, typename fn_t >
+void cc0::job::run_scenario(void *context, cc0::job &self, uint64_t scenario, void *result)
+{
+	const fn_t &fn = *reinterpret_cast<const fn_t*>(context);
+	new (result) result_t(fn(self, scenario));
+}
+
+template < typename result_t, typename fn_t >
+uint64_t cc0::job::fork_scenarios(uint64_t count, const fn_t &fn, result_t *results)
+{
+	static_assert(std::is_trivially_copyable<result_t>::value, "Results are copied between processes byte by byte, so they must be trivially copyable.");
+	return fork_scenarios(count, run_scenario<result_t,fn_t>, const_cast<fn_t*>(&fn), results, sizeof(result_t));
+}
+
 template < typename query_t >
 cc0::job::query::results cc0::job::filter_children(const query_t &q)
 {
@@ -1549,6 +3580,14 @@ bool cc0::job::register_job(const char *type_name)
 	return true;
 }
 
+template < typename job_t >
+bool cc0::job::declare_type(uint64_t base_id)
+{
+	get_type_listeners(job_t::type_id(), true)->base_id = base_id;
+	cc0::jobs_internal::listener_declarations<job_t>::declare();
+	return true;
+}
+
 template < typename job_t >
 void cc0::job::defer(void (job_t::*mem_fn)(job&), uint64_t delay_ns)
 {
@@ -1557,4 +3596,174 @@ void cc0::job::defer(void (job_t::*mem_fn)(job&), uint64_t delay_ns)
 	listen<job_t>("defer", *c, mem_fn);
 }
 
+#ifdef CC0_JOBS_TRAP_ALLOCATIONS
+
+#include <cstdlib>
+
+namespace cc0
+{
+	namespace jobs_internal
+	{
+		/// @brief Allocates heap memory on behalf of the replaced global allocation functions, and reports it to the allocation trap.
+		/// @param size The number of bytes to allocate.
+		/// @param align The required alignment of the memory. Zero for the default alignment of the heap.
+		/// @param call_site The address of the allocating new-expression.
+		/// @return The memory. Null if out of memory.
+		inline void *trapped_allocate(std::size_t size, std::size_t align, const void *call_site)
+		{
+			check_allocation(size, call_site);
+			size = size > 0 ? size : 1;
+			if (align == 0) {
+				return std::malloc(size);
+			}
+#if defined(_MSC_VER)
+			return _aligned_malloc(size, align);
+#elif defined(__cpp_aligned_new)
+			return std::aligned_alloc(align, (size + align - 1) & ~(align - 1)); // The size must be a multiple of the alignment.
+#else
+			return nullptr; // Explicit alignment is only requested by the aligned operator new of C++17.
+#endif
+		}
+
+		/// @brief Frees memory allocated by trapped_allocate.
+		/// @param p The memory.
+		/// @param aligned Indicates that the memory was allocated with an explicit alignment.
+		inline void trapped_free(void *p, bool aligned)
+		{
+#if defined(_MSC_VER)
+			if (aligned) {
+				_aligned_free(p);
+				return;
+			}
+#endif
+			(void)aligned;
+			std::free(p);
+		}
+	}
+}
+
+// The call site is captured in each replacement, since __builtin_return_address then refers to the new-expression.
+
+void *operator new(std::size_t size)
+{
+	void *p = cc0::jobs_internal::trapped_allocate(size, 0, CC0_JOBS_CALL_SITE);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](std::size_t size)
+{
+	void *p = cc0::jobs_internal::trapped_allocate(size, 0, CC0_JOBS_CALL_SITE);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return cc0::jobs_internal::trapped_allocate(size, 0, CC0_JOBS_CALL_SITE);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return cc0::jobs_internal::trapped_allocate(size, 0, CC0_JOBS_CALL_SITE);
+}
+
+void operator delete(void *p) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+void operator delete[](void *p) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, false);
+}
+
+#if defined(__cpp_aligned_new)
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+	void *p = cc0::jobs_internal::trapped_allocate(size, static_cast<std::size_t>(align), CC0_JOBS_CALL_SITE);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+	void *p = cc0::jobs_internal::trapped_allocate(size, static_cast<std::size_t>(align), CC0_JOBS_CALL_SITE);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return cc0::jobs_internal::trapped_allocate(size, static_cast<std::size_t>(align), CC0_JOBS_CALL_SITE);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return cc0::jobs_internal::trapped_allocate(size, static_cast<std::size_t>(align), CC0_JOBS_CALL_SITE);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	cc0::jobs_internal::trapped_free(p, true);
+}
+
+#endif
+
+#endif
+
 #endif
@@ -0,0 +1,44 @@
+/// @file
+/// @brief Checks that a warmed-up tree that defers a call every tick cycles without heap allocations.
+/// @note Build with: c++ -std=c++11 -I.. defer_allocations.cpp ../jobs.cpp -pthread
+
+#include <cstdio>
+#include "../jobs.h"
+
+static uint64_t g_allocations = 0;
+
+static void count_allocation(uint64_t, const void*)
+{
+	++g_allocations;
+}
+
+CC0_JOBS_NEW(deferring)
+{
+public:
+	uint64_t calls = 0;
+
+	void on_deferred(cc0::job&) {
+		++calls;
+	}
+
+protected:
+	void on_tick(uint64_t) {
+		defer<deferring>(&deferring::on_deferred, 2);
+	}
+};
+
+int main()
+{
+	cc0::job root;
+	deferring *d = root.add_child<deferring>();
+	for (int i = 0; i < 1000; ++i) {
+		root.cycle(1);
+	}
+	cc0::job::set_allocation_trap(count_allocation);
+	for (int i = 0; i < 100000; ++i) {
+		root.cycle(1);
+	}
+	cc0::job::set_allocation_trap(nullptr);
+	std::printf("allocations %llu, deferred calls %llu\n", (unsigned long long)g_allocations, (unsigned long long)d->calls);
+	return g_allocations == 0 && d->calls > 0 ? 0 : 1;
+}